@@ -16,34 +16,45 @@ QT += \
 
 HEADERS += \
     bagrov.h \
+    bagrovTable.h \
+    boundedQueue.h \
     calculation.h \
+    calculationKernel.h \
     config.h \
     constants.h \
     dbaseField.h \
     dbaseReader.h \
     dbaseWriter.h \
     effectivenessunsealed.h \
+    fixedWidthEncoder.h \
+    fixedWidthParser.h \
     helpers.h \
     initvalues.h \
     main.h \
     mainwindow.h \
     pdr.h \
-    saxhandler.h
+    saxhandler.h \
+    trace.h
 
 SOURCES += \
     bagrov.cpp \
+    bagrovTable.cpp \
     calculation.cpp \
+    calculationKernel.cpp \
     config.cpp \
     dbaseField.cpp \
     dbaseReader.cpp \
     dbaseWriter.cpp \
     effectivenessunsealed.cpp \
+    fixedWidthEncoder.cpp \
+    fixedWidthParser.cpp \
     helpers.cpp \
     initvalues.cpp \
     main.cpp \
     mainwindow.cpp \
     pdr.cpp \
-    saxhandler.cpp
+    saxhandler.cpp \
+    trace.cpp
 
 #RC_FILE += AbimoQt.rc
 #OTHER_FILES += release/config.xml
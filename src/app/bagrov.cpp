@@ -3,7 +3,7 @@
  * of this repository (https://github.com/KWB-R/abimo).
  ***************************************************************************/
 
-#include <QDebug>
+#include <QVarLengthArray>
 #include <math.h>
 
 #include "bagrov.h"
@@ -13,6 +13,33 @@
 
 #define UPPER_LIMIT_EYN 0.7F
 
+// Maximum number of steps of the 3. approximation (bag > 3.8)
+#define NEWTON_MAX_STEPS 15
+
+// Maximum number of halvings of the step of the Simpson integration
+#define SIMPSON_MAX_HALVINGS 16
+
+// Accuracy of nbagroExact(): largest Halley step of u after which the next
+// iterate is returned (its error is of the order of the cube of the step),
+// tolerance of the integration, maximum number of Halley steps and of
+// interval halvings of the integration, smallest term of the series and
+// smallest bag for which the series in w = 1 - y^bag is used
+#define EXACT_TOLERANCE 1.0e-4
+#define EXACT_INTEGRAL_TOLERANCE 1.0e-10
+#define EXACT_MAX_ITERATIONS 30
+#define EXACT_MAX_DEPTH 30
+#define EXACT_SERIES_TOLERANCE 1.0e-11
+#define EXACT_MIN_SERIES_BAG 0.05
+
+// Largest w = 1 - y^bag and r = y^bag for which the start value of
+// nbagroExact() is taken from the series in w or in r
+#define EXACT_START_W 0.3
+#define EXACT_START_R 0.1
+
+// Euler-Mascheroni constant and log(2)
+#define EULER 0.57721566490153286
+#define LN_TWO 0.69314718055994531
+
 #define ONE_THIRD 1.0F / 3.0F
 #define TWO_THIRDS 2.0F / 3.0F
 
@@ -33,7 +60,9 @@
  =======================================================================================================================
  */
 
-Bagrov::Bagrov()
+Bagrov::Bagrov():
+    coefficientCount(0),
+    nextSlot(0)
 {
 }
 
@@ -58,9 +87,8 @@ const float Bagrov::aa[]= {
 
 float Bagrov::nbagro(float bage, float x)
 {
-    int i, ia, ie, j;
-    float bag, bag_plus_one, reciprocal_bag_plus_one;
-    float a, a0, a1, a2, b, c, epa, eyn, h13, h23, sum_1, sum_2, w, y0;
+    int i;
+    float bag, y0, y1, y2;
 
     // General helper variable of type float
     float h;
@@ -76,35 +104,7 @@ float Bagrov::nbagro(float bage, float x)
     // Set local variable bag to value of parameter bage (20.0 at maximum)
     bag = MIN(bage, 20.0);
 
-    // Calculate expressions that are based on bag
-    bag_plus_one = bag + 1.0F;
-    reciprocal_bag_plus_one = (float) (1.0 / bag_plus_one);
-
-    h13 = (float) exp(-bag_plus_one * 1.09861);
-    h23 = (float) exp(-bag_plus_one * 0.405465);
-
-    // KOEFFIZIENTEN DER BEDINGUNGSGLEICHUNG
-    a2 = -13.5F * reciprocal_bag_plus_one * (1.0F + 3.0F * (h13 - h23));
-    a1 = 9.0F * reciprocal_bag_plus_one * (h13 + h13 - h23) - TWO_THIRDS * a2;
-    a0 = 1.0F / (1.0F - reciprocal_bag_plus_one - 0.5F * a1 - ONE_THIRD * a2);
-
-    // Multiply each of a1, a2 with a0
-    a1 *= a0;
-    a2 *= a0;
-
-    // KOEFFIZIENTEN DES LOESUNSANSATZES
-    b = (bag >= 0.49999F) ?
-        (- (float) sqrt(0.25 * a1 * a1 - a2) + 0.5F * a1) :
-        (- (float) sqrt(0.5F * a1 * a1 - a2));
-
-    c = a1 - b;
-    a = a0 / (b - c);
-
-    epa = (float) exp(x / a);
-
-    // NULLTE NAEHERUNGSLOESUNG (1. Naeherungsloesung)
-    // Limit y0 to its maximum allowed value
-    y0 = MIN((epa - 1.0F) / (b - c * epa), ALMOST_ONE);
+    y0 = firstApproximation(bag, x);
 
     // If bag is between a certain range return y0
     if (bag >= 0.7F && bag <= 3.8F) {
@@ -115,20 +115,328 @@ float Bagrov::nbagro(float bage, float x)
     if (bag >= 3.8F) {
         h = 1.0F;
         i = 0;
-        while(fabs(h) > 0.001 && i < 15) {
-            y0 = MIN(y0, 0.999F);
-            epa = (float) exp(bag * log(y0));
-            h = MIN(MAX(1.0F - epa, ALMOST_ZERO), ALMOST_ONE);
-            h *= (y0 + epa * y0 / (float) (h - bag * epa / (float) log(h)) - x);
-            y0 -= h;
+        y1 = y0;
+        while(fabs(h) > 0.001 && i < NEWTON_MAX_STEPS) {
+            y2 = y1;
+            y1 = y0;
+            h = newtonStep(bag, x, y0);
             i++;
+
+            if (i >= 2 && skipRepeatedSteps(i, h, y1, y2, y0)) {
+                break;
+            }
         }
 
         // Return y0 (1.0 at maximum)
         return MIN(y0, 1.0);
     }
 
-    // NUMERISCHE INTEGRATION FUER BAG<0.7 (2.Naeherungsloesung)
+    return seriesApproximation(bag, x, y0);
+}
+
+/*
+ =======================================================================================================================
+    Same as nbagro() for n pairs (bage[k], x[k]), results in y[k]. The pairs are partitioned by the approximation that
+    they need. The first approximation is calculated for all pairs in one loop, the iterations of the 3. approximation
+    are done for all of its pairs in lockstep (each pair until it converged or its iterates repeat), the 2.
+    approximation pair by pair. The results are exactly those of nbagro().
+ =======================================================================================================================
+ */
+void Bagrov::nbagro(const float* bage, const float* x, float* y, int n)
+{
+    // Capped inputs
+    QVarLengthArray<float, BATCH_CAPACITY> bags(n);
+    QVarLengthArray<float, BATCH_CAPACITY> xs(n);
+
+    // Indices of the pairs that need the 3. (newton) or 2. (series) approximation
+    QVarLengthArray<int, BATCH_CAPACITY> newton;
+    QVarLengthArray<int, BATCH_CAPACITY> series;
+
+    // Iterates of the 3. approximation before the last and before the last two steps
+    QVarLengthArray<float, BATCH_CAPACITY> y1s(n);
+    QVarLengthArray<float, BATCH_CAPACITY> y2s(n);
+
+    for (int k = 0; k < n; k++) {
+
+        if (x[k] < 0.0005F) {
+            y[k] = 0.0F;
+            continue;
+        }
+
+        xs[k] = MIN(x[k], 15.0F);
+        bags[k] = MIN(bage[k], 20.0);
+
+        y[k] = firstApproximation(bags[k], xs[k]);
+
+        if (bags[k] >= 0.7F && bags[k] <= 3.8F) {
+            continue;
+        }
+
+        if (bags[k] >= 3.8F) {
+            newton.append(k);
+            y1s[k] = y[k];
+        }
+        else {
+            series.append(k);
+        }
+    }
+
+    // Iterate over the pairs that did not converge yet, removing the others
+    QVarLengthArray<int, BATCH_CAPACITY> active = newton;
+    int activeCount = active.size();
+
+    for (int i = 1; i <= NEWTON_MAX_STEPS && activeCount > 0; i++) {
+
+        int remaining = 0;
+
+        for (int m = 0; m < activeCount; m++) {
+
+            int k = active[m];
+
+            y2s[k] = y1s[k];
+            y1s[k] = y[k];
+
+            float h = newtonStep(bags[k], xs[k], y[k]);
+
+            if (i >= 2 && skipRepeatedSteps(i, h, y1s[k], y2s[k], y[k])) {
+                continue;
+            }
+
+            if (fabs(h) > 0.001) {
+                active[remaining++] = k;
+            }
+        }
+
+        activeCount = remaining;
+    }
+
+    for (int m = 0; m < newton.size(); m++) {
+        int k = newton[m];
+        y[k] = MIN(y[k], 1.0);
+    }
+
+    for (int m = 0; m < series.size(); m++) {
+        int k = series[m];
+        y[k] = seriesApproximation(bags[k], xs[k], y[k]);
+    }
+}
+
+/*
+ =======================================================================================================================
+    Exact solution y of the Bagrov relation dy/dx = 1 - y^bag, y(0) = 0, i.e. of x = G(y), the integral of
+    1 / (1 - t^bag) from 0 to y, with bag and x limited as in nbagro(). G(y) = x is solved by Halley steps with the
+    analytic derivatives of G, starting from exactStart(). They are done in u = -log(1 - y), in which the derivative
+    exp(-u) / (1 - y^bag) of G is bounded (between 1 and 1/bag), so that they also converge for y close to 1. As the
+    steps converge cubically, the iterate after a step below EXACT_TOLERANCE is returned without evaluating G again.
+    G is calculated by the series of exactIntegral(), whose terms are kept per value of bag, or, where these converge
+    slowly, by adaptive integration from the previous value of u.
+ =======================================================================================================================
+ */
+float Bagrov::nbagroExact(float bage, float x)
+{
+    double bag, bagLog, e, lg, g, dg, r, w, y, u, uPrevious, f, h, integralU;
+
+    if (x <= 0.0F || bage <= 0.0F) {
+        return 0.0F;
+    }
+
+    x = MIN(x, 15.0F);
+    bag = MIN(bage, 20.0);
+
+    int slot = getSlot((float) bag);
+    SeriesTerms& terms = seriesTerms[slot];
+
+    // The slot may have been used for another value of bag before
+    if (!coefficients[slot].seriesTermsKnown) {
+        terms.psiKnown = false;
+        terms.yTermCount = 0;
+        terms.wTermCount = 0;
+        coefficients[slot].seriesTermsKnown = true;
+    }
+
+    if (!terms.psiKnown && bag >= EXACT_MIN_SERIES_BAG) {
+        terms.psi = digamma(1.0 / bag);
+        terms.psiKnown = true;
+    }
+
+    u = exactStart(coefficients[slot], terms, bag, x);
+
+    // G(0) = 0
+    uPrevious = 0.0;
+    integralU = 0.0;
+
+    for (int i = 0; i < EXACT_MAX_ITERATIONS; i++) {
+
+        // y = 1 - exp(-u), r = y^bag, w = 1 - r (each without cancellation)
+        e = exp(-u);
+        y = (e > 0.5) ? -expm1(-u) : 1.0 - e;
+        lg = log1p(-e);
+        bagLog = bag * lg;
+
+        if (bagLog < -LN_TWO) {
+            r = exp(bagLog);
+            w = 1.0 - r;
+        }
+        else {
+            w = -expm1(bagLog);
+            r = 1.0 - w;
+        }
+
+        if (!exactIntegral(terms, bag, y, r, w, integralU)) {
+            integralU += integral(bag, uPrevious, u);
+        }
+
+        uPrevious = u;
+
+        // G(u) - x, G'(u) = g(u) and G''(u) = dg(u)
+        f = integralU - x;
+        g = e / w;
+        dg = g * (bag * r * e / (y * w) - 1.0);
+
+        // Halley step, halve u instead of leaving the domain u > 0
+        h = 2.0 * f * g / (2.0 * g * g - f * dg);
+        u = (u - h > 0.0) ? u - h : 0.5 * u;
+
+        if (fabs(h) < EXACT_TOLERANCE * MAX(1.0, u)) {
+            break;
+        }
+    }
+
+    return (float) -expm1(-u);
+}
+
+/*
+ =======================================================================================================================
+    Start value u = -log(1 - y) of nbagroExact(). Where x is large, the series in w = 1 - y^bag of exactIntegral()
+    with its first two terms is solved for w, where x is small, the series in r = y^bag with its first three terms
+    for y (each by two fixed point steps). Their errors are then of the order of the next terms, otherwise the first
+    approximation of nbagro() is taken.
+ =======================================================================================================================
+ */
+double Bagrov::exactStart(
+    const Coefficients& coefficients, const SeriesTerms& terms, double bag,
+    double x
+)
+{
+    double c1, c2, q, r, w, y;
+    float y0;
+
+    if (terms.psiKnown) {
+
+        // -log(w) = bag * x + EULER + psi + c(1) * w + c(2) * w^2 / 2
+        c1 = 1.0 - 1.0 / bag;
+        c2 = 0.25 * c1 * (2.0 - 1.0 / bag);
+        q = bag * x + EULER + terms.psi;
+        w = exp(-q);
+
+        if (w < EXACT_START_W) {
+
+            for (int i = 0; i < 2; i++) {
+                w = exp(-(q + w * (c1 + c2 * w)));
+            }
+
+            // 1 - y = 1 - (1 - w)^(1/bag)
+            return -log(-expm1(log1p(-w) / bag));
+        }
+    }
+
+    // x = y * (1 + r / (bag + 1) + r^2 / (2 * bag + 1))
+    y = MIN(x, ALMOST_ONE);
+    r = exp(bag * log(y));
+
+    if (r < EXACT_START_R) {
+
+        for (int i = 0; i < 2; i++) {
+            y = x / (1.0 + r * (1.0 / (bag + 1.0) + r / (2.0 * bag + 1.0)));
+            r = exp(bag * log(y));
+        }
+
+        return -log1p(-y);
+    }
+
+    // The first approximation fails for very small values of bag
+    y0 = firstApproximation(coefficients, (float) x);
+
+    if (!(y0 > 0.0F)) {
+        y0 = MIN((float) x, 0.5F);
+    }
+
+    return -log1p(-y0);
+}
+
+/*
+ =======================================================================================================================
+    NULLTE NAEHERUNGSLOESUNG (1. Naeherungsloesung)
+ =======================================================================================================================
+ */
+float Bagrov::firstApproximation(float bag, float x)
+{
+    return firstApproximation(getCoefficients(bag), x);
+}
+
+// Same with the coefficients of bag
+float Bagrov::firstApproximation(const Coefficients& coefficients, float x)
+{
+    float epa;
+
+    epa = (float) exp(x / coefficients.a);
+
+    // Limit y0 to its maximum allowed value
+    return MIN((epa - 1.0F) / (coefficients.b - coefficients.c * epa), ALMOST_ONE);
+}
+
+/*
+ =======================================================================================================================
+    One step of the NUMERISCHE INTEGRATION FUER BAG > 3.8 (3. Naeherungsloesung), returns the correction h of y0
+ =======================================================================================================================
+ */
+float Bagrov::newtonStep(float bag, float x, float& y0)
+{
+    float epa, h;
+
+    y0 = MIN(y0, 0.999F);
+    epa = (float) exp(bag * log(y0));
+    h = MIN(MAX(1.0F - epa, ALMOST_ZERO), ALMOST_ONE);
+    h *= (y0 + epa * y0 / (float) (h - bag * epa / (float) log(h)) - x);
+    y0 -= h;
+
+    return h;
+}
+
+/*
+ =======================================================================================================================
+    Whether the iterate y0 after step i of the 3. approximation equals the one before the last two steps (y2), while
+    the step h does not end the iteration. As newtonStep() only depends on y0 (for the same bag and x), the iterates
+    then alternate between y0 and the previous one (y1) up to step NEWTON_MAX_STEPS, so that y0 is set to the one of
+    that step and the remaining steps can be skipped. Most iterations for bag > 3.8 end in such a cycle.
+ =======================================================================================================================
+ */
+bool Bagrov::skipRepeatedSteps(int i, float h, float y1, float y2, float& y0)
+{
+    if (y0 != y2 || !(fabs(h) > 0.001)) {
+        return false;
+    }
+
+    if ((NEWTON_MAX_STEPS - i) % 2 != 0) {
+        y0 = y1;
+    }
+
+    return true;
+}
+
+/*
+ =======================================================================================================================
+    NUMERISCHE INTEGRATION FUER BAG<0.7 (2.Naeherungsloesung), starting with the first approximation y0
+ =======================================================================================================================
+ */
+float Bagrov::seriesApproximation(float bag, float x, float y0)
+{
+    int i, ia, ie, j;
+    float eyn, sum_1, sum_2, w;
+
+    // General helper variable of type float
+    float h;
+
     //j = 1;
 
     while (true/*j <= 30*/)
@@ -191,97 +499,294 @@ float Bagrov::nbagro(float bage, float x)
 
 /*
  =======================================================================================================================
-    FIXME:
+    Slot of the coefficients a, b, c of the solution for bag, which are taken from the last COEFFICIENT_SLOTS values of
+    bag if possible. The values in the slot of the oldest value of bag are otherwise replaced.
  =======================================================================================================================
  */
-void Bagrov::bagrov(float *bagf, float *x0, float *y0)
+int Bagrov::getSlot(float bag)
 {
-    bool doloop; /* LOGICAL16 */
-    int _do0, i, ii, j;
+    float bag_plus_one, reciprocal_bag_plus_one;
+    float a0, a1, a2, b, h13, h23;
+    int slot;
+
+    for (int k = 0; k < coefficientCount; k++) {
+        if (coefficients[k].bag == bag) {
+            return k;
+        }
+    }
+
+    // Calculate expressions that are based on bag
+    bag_plus_one = bag + 1.0F;
+    reciprocal_bag_plus_one = (float) (1.0 / bag_plus_one);
+
+    h13 = (float) exp(-bag_plus_one * 1.09861);
+    h23 = (float) exp(-bag_plus_one * 0.405465);
+
+    // KOEFFIZIENTEN DER BEDINGUNGSGLEICHUNG
+    a2 = -13.5F * reciprocal_bag_plus_one * (1.0F + 3.0F * (h13 - h23));
+    a1 = 9.0F * reciprocal_bag_plus_one * (h13 + h13 - h23) - TWO_THIRDS * a2;
+    a0 = 1.0F / (1.0F - reciprocal_bag_plus_one - 0.5F * a1 - ONE_THIRD * a2);
+
+    // Multiply each of a1, a2 with a0
+    a1 *= a0;
+    a2 *= a0;
+
+    // KOEFFIZIENTEN DES LOESUNSANSATZES
+    b = (bag >= 0.49999F) ?
+        (- (float) sqrt(0.25 * a1 * a1 - a2) + 0.5F * a1) :
+        (- (float) sqrt(0.5F * a1 * a1 - a2));
 
-    qDebug() << "In bagrov()...";
+    // Replace the oldest entry when all slots are used
+    slot = nextSlot;
+    nextSlot = (nextSlot + 1) % COEFFICIENT_SLOTS;
 
-    /* meiko : initialisiere i (einzige Aenderung) */
-    i = 0;
+    if (coefficientCount < COEFFICIENT_SLOTS) {
+        coefficientCount++;
+    }
 
-    float	delta, du, h, s, s1, sg, si, su, u, x;
+    Coefficients& entry = coefficients[slot];
+    entry.bag = bag;
+    entry.b = b;
+    entry.c = a1 - b;
+    entry.a = a0 / (b - entry.c);
+    entry.seriesTermsKnown = false;
+
+    return slot;
+}
+
+// Coefficients a, b, c of the solution for bag (see getSlot())
+const Bagrov::Coefficients& Bagrov::getCoefficients(float bag)
+{
+    return coefficients[getSlot(bag)];
+}
+
+/*
+ =======================================================================================================================
+    Solves the Bagrov relation for y0 by numerical integration (the original BAGROV subroutine): y0 is corrected up to
+    10 times by delta = (x0 - integral(y0)) * (1 - y0^bag). Gives y0 = 1 if x0 exceeds the integral up to 0.99.
+ =======================================================================================================================
+ */
+void Bagrov::bagrov(float *bagf, float *x0, float *y0)
+{
+    float delta, x;
+
+    if (*x0 == 0.0) {
+        *y0 = 0.0F;
+        return;
+    }
 
-    if (*x0 == 0.0) goto L_10;
     *y0 = 0.99F;
-    goto L_20;
-L_10:
-    *y0 = 0.0F;
-    return;
-L_20:
-    doloop = false;
-
-    /* NUMERISCHE INTEGRATION DER BAGROVBEZIEHUNG */
-L_21:
+
+    if (*x0 > simpsonIntegral(*bagf, *y0)) {
+        *y0 = 1.0F;
+        return;
+    }
+
+    *y0 = 0.5F;
+
+    /* SCHLEIFE I=1(1)10 ZUR BERECHNUNG VON DELTA */
+    for (int i = 1; i <= 10; i++)
+    {
+        x = simpsonIntegral(*bagf, *y0);
+
+        delta = (*x0 - x) * (1.0F - (float) exp(*bagf * (float) log(*y0)));
+        *y0 = *y0 + delta;
+
+        if (*y0 >= 1.0) {
+            *y0 = 0.99F;
+        }
+        else if (*y0 <= 0.0) {
+            *y0 = 0.01F;
+        }
+        else if (fabs(delta) < 0.01F) {
+            return;
+        }
+    }
+}
+
+/*
+ =======================================================================================================================
+    NUMERISCHE INTEGRATION DER BAGROVBEZIEHUNG: integral of 1 / (1 - u^bag) from 0 to y0 (Simpson's rule, halving the
+    step until the relative change is below 0.001 or SIMPSON_MAX_HALVINGS times: where the float sums stall above that
+    change, it would otherwise take seconds)
+ =======================================================================================================================
+ */
+float Bagrov::simpsonIntegral(float bag, float y0)
+{
+    int j;
+    float du, h, s, sg, si, su, u;
+
     j = 1;
-    du = 2.0F **y0;
-    h = 1.0F + 1.0F / (1.0F - (float) exp(*bagf * log(*y0)));
+    du = 2.0F * y0;
+    h = 1.0F + 1.0F / (1.0F - (float) exp(bag * log(y0)));
     si = h * du / 4.0F;
     sg = 0.0F;
     su = 0.0F;
-L_1:
-    s = si;
-    j = j * 2;
-    du = du / 2.0F;
-    u = du / 2.0F;
-    sg = sg + su;
-    su = 0.0F;
 
-    for (ii = 1, _do0 = j; ii <= _do0; ii += 2)
+    do
     {
-        su = su + 1.0F / (1.0F - (float) exp(*bagf * log(u)));
-        u = u + du;
+        s = si;
+        j = j * 2;
+        du = du / 2.0F;
+        u = du / 2.0F;
+        sg = sg + su;
+        su = 0.0F;
+
+        for (int ii = 1; ii <= j; ii += 2)
+        {
+            su = su + 1.0F / (1.0F - (float) exp(bag * log(u)));
+            u = u + du;
+        }
+
+        si = (2.0F * sg + 4.0F * su + h) * du / 6.0F;
     }
+    while (fabs(s - si) > 0.001F * s && j < (1 << SIMPSON_MAX_HALVINGS));
 
-    si = (2.0F * sg + 4.0F * su + h) * du / 6.0F;
-    s1 = 0.001F * s;
-    if (fabs(s - si) > s1) goto L_1;
-    x = si;
+    return si;
+}
 
-    /* ENDE DER NUMERISCHEN INTEGRATION */
-    if (doloop) goto L_42;
-    if (*x0 > x) goto L_30;
-    *y0 = 0.5F;
-    goto L_40;
-L_30:
-    *y0 = 1.0F;
-    return;
-L_40:
-    i = 1;
+/*
+ =======================================================================================================================
+    Integral G of 1 / (1 - t^bag) from 0 to y, with r = y^bag and w = 1 - r, by a series in r (for r <= 0.5):
+        G = y * sum(r^k / (k * bag + 1)), k >= 0
+    or by a series in w (for w < 0.5), with the digamma function psi of 1/bag and the coefficients c(k) of
+    (1 - w)^(1/bag - 1) = sum(c(k) * w^k):
+        G = (-log(w) - EULER - psi - sum(c(k) * w^k / k)) / bag, k >= 1
+    The terms that do not depend on y (and psi) are taken from the series terms of bag, and added to them when a series
+    needs more of them. The coefficients of the latter grow with 1/bag, so that it is not used for
+    bag < EXACT_MIN_SERIES_BAG.
+    Returns false if none of them applies or if a series needs more than EXACT_SERIES_TERMS terms.
+ =======================================================================================================================
+ */
+bool Bagrov::exactIntegral(
+    SeriesTerms& terms, double bag, double y, double r, double w, double& result
+)
+{
+    double c, p, sum, term;
 
-    /* SCHLEIFE I=1(1)10 ZUR BERECHNUNG VON DELTA */
-L_41:
-    doloop = true;
-    goto L_21;
-L_42:
-    delta = (*x0 - x) * (1.0F - (float) exp(*bagf * (float) log(*y0)));
-    *y0 = *y0 + delta;
-    if (*y0 >= 1.0) goto L_50;
-    if (*y0 <= 0.0) goto L_60;
-    goto L_70;
-L_50:
-    *y0 = 0.99F;
-    goto L_90;
-L_60:
-    *y0 = 0.01F;
-    goto L_90;
-L_70:
-    if (fabs(delta) < 0.01F) goto L_80;
-    goto L_90;
-L_80:
-    ;
-    return;
-L_90:
-    if (i < 10) goto L_91;
-    goto L_92;
-L_91:
-    i = i + 1;
-    goto L_41;
-L_92:
-    ;
-    return;
-}	/* end of function */
+    sum = 0.0;
+    p = 1.0;
+
+    if (r <= 0.5) {
+
+        for (int k = 0; p > EXACT_SERIES_TOLERANCE; k++) {
+
+            if (k == terms.yTermCount) {
+
+                if (k == EXACT_SERIES_TERMS) {
+                    return false;
+                }
+
+                terms.yTerms[k] = 1.0 / (k * bag + 1.0);
+                terms.yTermCount++;
+            }
+
+            sum += p * terms.yTerms[k];
+            p *= r;
+        }
+
+        result = y * sum;
+        return true;
+    }
+
+    if (bag < EXACT_MIN_SERIES_BAG) {
+        return false;
+    }
+
+    for (int k = 1; ; k++) {
+
+        if (k > terms.wTermCount) {
+
+            if (k > EXACT_SERIES_TERMS) {
+                return false;
+            }
+
+            // c(k - 1) is k - 1 times the previous term, c(0) = 1
+            c = (k == 1) ? 1.0 : terms.wTerms[k - 2] * (k - 1);
+            terms.wTerms[k - 1] = c * (k - 1.0 / bag) / (k * k);
+            terms.wTermCount++;
+        }
+
+        p *= w;
+        term = terms.wTerms[k - 1] * p;
+        sum += term;
+
+        if (fabs(term) <= EXACT_SERIES_TOLERANCE) {
+            break;
+        }
+    }
+
+    result = (-log(w) - EULER - terms.psi - sum) / bag;
+    return true;
+}
+
+/*
+ =======================================================================================================================
+    Digamma function (logarithmic derivative of the gamma function), by recurrence and asymptotic series
+ =======================================================================================================================
+ */
+double Bagrov::digamma(double a)
+{
+    double f, result = 0.0;
+
+    while (a < 6.0) {
+        result -= 1.0 / a;
+        a += 1.0;
+    }
+
+    f = 1.0 / (a * a);
+
+    return result + log(a) - 0.5 / a -
+        f * (1.0 / 12 - f * (1.0 / 120 - f * (1.0 / 252 - f * (1.0 / 240 - f / 132))));
+}
+
+/*
+ =======================================================================================================================
+    Integrand g(v) = exp(-v) / (1 - (1 - exp(-v))^bag) of G in v = -log(1 - t) (see nbagroExact())
+ =======================================================================================================================
+ */
+double Bagrov::integrand(double bag, double v)
+{
+    double e = exp(-v);
+
+    return e / -expm1(bag * log1p(-e));
+}
+
+/*
+ =======================================================================================================================
+    Integral of integrand() from a to b (adaptive Simpson's rule, each interval is only divided where the error
+    estimate requires it, the values at its ends and its middle are passed on to its halves)
+ =======================================================================================================================
+ */
+double Bagrov::integral(double bag, double a, double b)
+{
+    double fa = integrand(bag, a);
+    double fm = integrand(bag, 0.5 * (a + b));
+    double fb = integrand(bag, b);
+
+    return adaptiveSimpson(
+        bag, a, b, fa, fm, fb, (b - a) / 6.0 * (fa + 4.0 * fm + fb),
+        EXACT_INTEGRAL_TOLERANCE, EXACT_MAX_DEPTH
+    );
+}
+
+double Bagrov::adaptiveSimpson(
+    double bag, double a, double b, double fa, double fm, double fb,
+    double whole, double tolerance, int depth
+)
+{
+    double m = 0.5 * (a + b);
+    double flm = integrand(bag, 0.5 * (a + m));
+    double frm = integrand(bag, 0.5 * (m + b));
+    double left = (m - a) / 6.0 * (fa + 4.0 * flm + fm);
+    double right = (b - m) / 6.0 * (fm + 4.0 * frm + fb);
+    double delta = left + right - whole;
+
+    if (depth <= 0 || fabs(delta) <= 15.0 * tolerance) {
+        return left + right + delta / 15.0;
+    }
+
+    return
+        adaptiveSimpson(bag, a, m, fa, flm, fm, left, 0.5 * tolerance, depth - 1) +
+        adaptiveSimpson(bag, m, b, fm, frm, fb, right, 0.5 * tolerance, depth - 1);
+}
@@ -6,16 +6,85 @@
 #ifndef BAGROV_H /* Prevent multiple includes */
 #define BAGROV_H
 
+// Number of values of bag for which a Bagrov object keeps the coefficients
+#define COEFFICIENT_SLOTS 8
+
+// Number of pairs (bag, x) up to which nbagro() of arrays needs no heap memory
+#define BATCH_CAPACITY 64
+
+// Number of terms of the series of nbagroExact() that are kept per value of bag
+#define EXACT_SERIES_TERMS 64
+
+// Solver of the Bagrov relation. The coefficients of the last values of bag
+// are kept, so that calls with the same bag (e.g. the constant values of the
+// sealed surfaces) only calculate the part that depends on x. The same holds
+// for the terms of the series of nbagroExact(). A Bagrov object must therefore
+// not be used by more than one thread at a time.
 class Bagrov
 {
 
 public:
     Bagrov();
     float nbagro(float bage, float x);
+    void nbagro(const float* bage, const float* x, float* y, int n);
+    float nbagroExact(float bage, float x);
     void bagrov(float *bagf, float *x0, float *y0);
 
 private:
+    // Coefficients of the solution that only depend on bag
+    struct Coefficients {
+        float bag;
+        float a;
+        float b;
+        float c;
+
+        // Whether the series terms in the same slot belong to bag
+        bool seriesTermsKnown;
+    };
+
+    // Digamma of 1 / bag and the terms 1 / (k * bag + 1) and c(k) / k of the
+    // series of exactIntegral(), calculated as far as they are used. They are
+    // kept apart from the coefficients (in the same slot), so that these fit
+    // into few cache lines.
+    struct SeriesTerms {
+        bool psiKnown;
+        double psi;
+        int yTermCount;
+        int wTermCount;
+        double yTerms[EXACT_SERIES_TERMS];
+        double wTerms[EXACT_SERIES_TERMS];
+    };
+
     const static float aa[];
+    Coefficients coefficients[COEFFICIENT_SLOTS];
+    SeriesTerms seriesTerms[COEFFICIENT_SLOTS];
+    int coefficientCount;
+    int nextSlot;
+
+    int getSlot(float bag);
+    const Coefficients& getCoefficients(float bag);
+    float firstApproximation(float bag, float x);
+    static float firstApproximation(const Coefficients& coefficients, float x);
+    static float newtonStep(float bag, float x, float& y0);
+    static bool skipRepeatedSteps(int i, float h, float y1, float y2, float& y0);
+    float seriesApproximation(float bag, float x, float y0);
+    static float simpsonIntegral(float bag, float y0);
+
+    static double exactStart(
+        const Coefficients& coefficients, const SeriesTerms& terms, double bag,
+        double x
+    );
+    static bool exactIntegral(
+        SeriesTerms& terms, double bag, double y, double r, double w,
+        double& result
+    );
+    static double digamma(double a);
+    static double integrand(double bag, double v);
+    static double integral(double bag, double a, double b);
+    static double adaptiveSimpson(
+        double bag, double a, double b, double fa, double fm, double fb,
+        double whole, double tolerance, int depth
+    );
 };
 
 #endif
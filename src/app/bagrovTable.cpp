@@ -0,0 +1,194 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#include <math.h>
+#include <QtGlobal>
+#include <QVector>
+
+#include "bagrov.h"
+#include "bagrovTable.h"
+
+// Grids of the table: bag from BAG_MIN to BAG_MAX, x from 0 to X_MAX. Each
+// regime is divided into equal cells of about BAG_STEP in bag.
+// With these steps the table has about 600000 values (2.3 MB).
+#define BAG_MIN 0.1F
+#define BAG_MAX 20.0F
+#define BAG_STEP 0.02F
+#define X_MAX 15.0F
+#define X_STEP 0.025F
+
+// Below this x the solver returns 0
+#define X_MIN 0.0005F
+
+// Number of sample points per cell and direction for the error estimate
+#define ERROR_SAMPLES 4
+
+// Values of bag at which the solver switches between its approximations, so
+// that its result jumps (see regimeOf())
+const float BagrovTable::jumps[] = {0.49999F, 0.7F, 3.8F};
+
+BagrovTable::BagrovTable():
+    xCount(0),
+    errorEstimate(0.0F)
+{
+    for (int r = 0; r < BAGROV_TABLE_REGIMES; r++) {
+        regimes[r].bagMin = 0.0F;
+        regimes[r].bagMax = 0.0F;
+        regimes[r].bagStep = 0.0F;
+        regimes[r].bagCount = 0;
+        regimes[r].offset = 0;
+    }
+}
+
+// =============================================================================
+// Calculates the values on the grids with the solver and compares the
+// interpolated values at ERROR_SAMPLES x ERROR_SAMPLES points inside each cell
+// with the solver (this takes about ten times as long as building the grids)
+// =============================================================================
+void BagrovTable::build()
+{
+    Bagrov bagrov;
+
+    xCount = (int) round(X_MAX / X_STEP) + 1;
+
+    int rowCount = 0;
+
+    for (int r = 0; r < BAGROV_TABLE_REGIMES; r++) {
+
+        Regime& regime = regimes[r];
+
+        regime.bagMin = (r == 0) ? BAG_MIN : jumps[r - 1];
+        regime.bagMax = (r == BAGROV_TABLE_REGIMES - 1) ? BAG_MAX : jumps[r];
+
+        int cellCount = (int) ceil((regime.bagMax - regime.bagMin) / BAG_STEP - 0.001F);
+
+        regime.bagStep = (regime.bagMax - regime.bagMin) / cellCount;
+        regime.bagCount = cellCount + 1;
+        regime.offset = rowCount;
+
+        rowCount += regime.bagCount;
+    }
+
+    values.resize(rowCount * xCount);
+
+    for (int r = 0; r < BAGROV_TABLE_REGIMES; r++) {
+
+        const Regime& regime = regimes[r];
+
+        for (int i = 0; i < regime.bagCount; i++) {
+
+            float bag = regime.bagMin + i * regime.bagStep;
+
+            // A jump belongs to one of the regimes next to it. The other one
+            // takes the value of the solver next to the jump instead.
+            if (i == 0 && regimeOf(bag) != r) {
+                bag = nextafterf(regime.bagMin, BAG_MAX);
+            }
+            else if (i == regime.bagCount - 1) {
+                bag = (regimeOf(regime.bagMax) == r) ?
+                    regime.bagMax : nextafterf(regime.bagMax, 0.0F);
+            }
+
+            for (int j = 0; j < xCount; j++) {
+                values[(regime.offset + i) * xCount + j] = bagrov.nbagro(bag, j * X_STEP);
+            }
+        }
+    }
+
+    errorEstimate = 0.0F;
+
+    for (int r = 0; r < BAGROV_TABLE_REGIMES; r++) {
+
+        const Regime& regime = regimes[r];
+
+        for (int i = 0; i < regime.bagCount - 1; i++) {
+            for (int k = 0; k < ERROR_SAMPLES; k++) {
+
+                float bag = regime.bagMin +
+                    (i + (k + 0.5F) / ERROR_SAMPLES) * regime.bagStep;
+
+                for (int j = 0; j < xCount - 1; j++) {
+                    for (int l = 0; l < ERROR_SAMPLES; l++) {
+
+                        float x = (j + (l + 0.5F) / ERROR_SAMPLES) * X_STEP;
+
+                        errorEstimate = qMax(errorEstimate,
+                            (float) fabs(nbagro(bag, x) - bagrov.nbagro(bag, x)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool BagrovTable::isEmpty() const
+{
+    return values.isEmpty();
+}
+
+float BagrovTable::getErrorEstimate() const
+{
+    return errorEstimate;
+}
+
+float BagrovTable::nbagro(float bag, float x) const
+{
+    // Not covered by the grids (also NaN)
+    if (!(bag >= BAG_MIN)) {
+        Bagrov bagrov;
+        return bagrov.nbagro(bag, x);
+    }
+
+    // As the solver: no evaporation below X_MIN
+    if (x < X_MIN) {
+        return 0.0F;
+    }
+
+    bag = qMin(bag, BAG_MAX);
+
+    return interpolate(regimes[regimeOf(bag)], bag, x);
+}
+
+// Index of the regime of the solver that bag belongs to, with the same
+// comparisons as in Bagrov::nbagro() and Bagrov::getSlot()
+int BagrovTable::regimeOf(float bag)
+{
+    // Series approximation, b of the solution for small bag
+    if (bag < jumps[0]) {
+        return 0;
+    }
+
+    // Series approximation, b of the solution for larger bag
+    if (bag < jumps[1]) {
+        return 1;
+    }
+
+    // First approximation
+    if (bag <= jumps[2]) {
+        return 2;
+    }
+
+    // Newton iteration
+    return 3;
+}
+
+// Bilinear interpolation between the four values around (bag, x) in the grid of
+// a regime that contains bag
+float BagrovTable::interpolate(const Regime& regime, float bag, float x) const
+{
+    float u = qMax(bag - regime.bagMin, 0.0F) / regime.bagStep;
+    float v = qBound(0.0F, x, X_MAX) / X_STEP;
+
+    int i = qMin((int) u, regime.bagCount - 2);
+    int j = qMin((int) v, xCount - 2);
+
+    float s = qMin(u - i, 1.0F);
+    float t = v - j;
+
+    const float* y = values.constData() + (regime.offset + i) * xCount + j;
+
+    return (1.0F - s) * ((1.0F - t) * y[0] + t * y[1]) +
+        s * ((1.0F - t) * y[xCount] + t * y[xCount + 1]);
+}
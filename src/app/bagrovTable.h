@@ -0,0 +1,65 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#ifndef BAGROVTABLE_H
+#define BAGROVTABLE_H
+
+#include <QVector>
+
+// How the Bagrov relation y = f(bag, x) of the unsealed surfaces is solved
+enum struct BagrovSolver {
+    // Bagrov::nbagro() for each record
+    Legacy = 0,
+    // interpolated in a table of Bagrov::nbagro() values (BagrovTable)
+    Table = 1,
+    // Bagrov::nbagroExact() for each record
+    Exact = 2
+};
+
+// Number of regimes of Bagrov::nbagro() between its jumps in bag
+#define BAGROV_TABLE_REGIMES 4
+
+// Values of Bagrov::nbagro() on regular grids of (bag, x), interpolated
+// bilinearly. The solver switches between its approximations at some values of
+// bag, where its result jumps. Each regime between two jumps has a grid of its
+// own with grid lines on both ends, so that no value is interpolated across a
+// jump. The solver caps bag at 20 and x at 15, so that the grids cover
+// everything but very small values of bag, for which the solver is called.
+// The table is built once and then only read, so that it can be shared by any
+// number of threads.
+class BagrovTable
+{
+public:
+    BagrovTable();
+    void build();
+    bool isEmpty() const;
+    float nbagro(float bag, float x) const;
+
+    // Estimate of the largest absolute difference to Bagrov::nbagro(): the
+    // largest one at the sample points of all cells, determined in build()
+    float getErrorEstimate() const;
+
+private:
+    // Grid of one regime: bagCount grid lines from bagMin to bagMax, starting
+    // in row offset of values
+    struct Regime {
+        float bagMin;
+        float bagMax;
+        float bagStep;
+        int bagCount;
+        int offset;
+    };
+
+    QVector<float> values;
+    Regime regimes[BAGROV_TABLE_REGIMES];
+    int xCount;
+    float errorEstimate;
+
+    const static float jumps[];
+    static int regimeOf(float bag);
+    float interpolate(const Regime& regime, float bag, float x) const;
+};
+
+#endif // BAGROVTABLE_H
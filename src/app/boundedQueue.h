@@ -0,0 +1,60 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QSemaphore>
+#include <QVector>
+
+// Ring buffer with a fixed number of slots that connects exactly one producer
+// thread with exactly one consumer thread. The producer blocks while all slots
+// are used, the consumer blocks while no slot is used. The two semaphores are
+// the only synchronisation: each index is only touched by one of the threads.
+template <typename T>
+class BoundedQueue
+{
+
+public:
+    BoundedQueue(int capacity):
+        items(capacity),
+        freeSlots(capacity),
+        usedSlots(0),
+        head(0),
+        tail(0)
+    {}
+
+    // Called by the producer thread only
+    void push(const T& item)
+    {
+        freeSlots.acquire();
+        items[tail] = item;
+        tail = (tail + 1) % items.size();
+        usedSlots.release();
+    }
+
+    // Called by the consumer thread only
+    T pop()
+    {
+        usedSlots.acquire();
+        T item = items[head];
+
+        // Release the memory held by the slot
+        items[head] = T();
+        head = (head + 1) % items.size();
+        freeSlots.release();
+
+        return item;
+    }
+
+private:
+    QVector<T> items;
+    QSemaphore freeSlots;
+    QSemaphore usedSlots;
+    int head;
+    int tail;
+};
+
+#endif
@@ -3,70 +3,115 @@
  * of this repository (https://github.com/KWB-R/abimo).
  ***************************************************************************/
 
-#include <math.h>
-#include <QDebug>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSemaphore>
 #include <QString>
 #include <QTextStream>
+#include <QWaitCondition>
 
-#include "bagrov.h"
+#include "bagrovTable.h"
+#include "boundedQueue.h"
 #include "calculation.h"
+#include "calculationKernel.h"
 #include "config.h"
-#include "constants.h"
 #include "dbaseReader.h"
 #include "dbaseWriter.h"
-#include "effectivenessunsealed.h"
 #include "helpers.h"
 #include "initvalues.h"
-#include "pdr.h"
+#include "trace.h"
 
-// potential ascent rate TAS (column labels for matrix 'Calculation::ijkr_S')
-const float Calculation::iTAS[] = {
-    0.1F, 0.2F, 0.3F, 0.4F, 0.5F, 0.6F, 0.7F, 0.8F,
-    0.9F, 1.0F, 1.2F, 1.4F, 1.7F, 2.0F, 2.3F
-};
+// Number of records that are read and converted at once
+#define RECORDS_PER_CHUNK 4096
+
+// Number of chunks that may wait between two stages of the pipelined mode
+#define BATCHES_IN_FLIGHT 4
+
+// Number of characters before the decimal point of numeric output fields when
+// streaming the results
+#define OUTPUT_INTEGER_WIDTH 10
 
-// soil type unknown - default soil type used in the following: sand
+// Chunk of input records passed from the reader stage to the calculation
+struct InputBatch {
+    abimoColumns columns;
+    int count = 0;
+};
 
-// Usable field capacity nFK (row labels for matrix 'Calculation::ijkr_S')
-const float Calculation::inFK_S[] = {
-    8.0F, 9.0F, 14.0F, 14.5F, 15.5F, 17.0F, 20.5F
+// Results of one chunk passed from the calculation to the writer stage
+struct OutputBatch {
+    QVector<abimoOutputRecord> records;
+    bool last = false;
 };
 
-/* Mean potential capillary rise rate kr [mm/d] of a summer season depending on:
- * potential ascent rate TAS (one column each) and
- * usable field capacity nFK (one row each) */
-const float Calculation::ijkr_S[] = {
-    7.0F, 6.0F, 5.0F, 1.5F, 0.5F, 0.2F, 0.1F, 0.0F, 0.0F, 0.0F,  0.0F , 0.0F, 0.0F , 0.0F, 0.0F,
-    7.0F, 7.0F, 6.0F, 5.0F, 3.0F, 1.2F, 0.5F, 0.2F, 0.1F, 0.0F,  0.0F , 0.0F, 0.0F , 0.0F, 0.0F,
-    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 3.0F, 1.5F, 0.7F, 0.3F, 0.15F, 0.1F , 0.0F, 0.0F , 0.0F, 0.0F,
-    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 3.0F, 2.0F, 1.0F, 0.7F, 0.4F,  0.15F, 0.1F, 0.0F , 0.0F, 0.0F,
-    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 4.5F, 2.5F, 1.5F, 0.7F, 0.4F,  0.15F, 0.1F, 0.0F , 0.0F, 0.0F,
-    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 5.0F, 3.5F, 2.0F, 1.5F, 0.8F,  0.3F , 0.1F, 0.05F, 0.0F, 0.0F,
-    7.0F, 7.0F, 6.0F, 6.0F, 6.0F, 5.0F, 5.0F, 5.0F, 3.0F, 2.0F,  1.0F , 0.5F, 0.15F, 0.0F, 0.0F
+// Number of chunks per thread that may be calculated ahead of the chunk that
+// is written next in the multi-threaded mode
+#define CHUNKS_AHEAD_PER_THREAD 2
+
+// Results of one chunk calculated by one of several threads
+struct ChunkResult {
+    QVector<abimoOutputRecord> records;
+    QString protocol;
+    int count = 0;
 };
 
 Calculation::Calculation(DbaseReader& dbR, InitValues & init, QTextStream & protoStream):
     initValues(init),
     protokollStream(protoStream),
     dbReader(dbR),
-    regenja(0),
-    regenso(0),
-    RDV(0),
-    R1V(0),
-    R2V(0),
-    R3V(0),
-    R4V(0),
-    RUV(0),
-    ROWVOL(0),
-    RIVOL(0),
-    RVOL(0),
-    TAS(0),
-    lenTAS(15),
-    lenS(7),
     counters({0, 0, 0, 0L, 0L, 0L}),
-    weiter(true)
+    weiter(true),
+    pipelined(false),
+    writeMode(WriteMode::Collect),
+    threadCount(1),
+    strict(true),
+    bagrovSolver(BagrovSolver::Legacy),
+    deduplicate(true),
+    partitioned(false)
+{
+}
+
+void Calculation::setPipelined(bool value)
+{
+    pipelined = value;
+}
+
+void Calculation::setWriteMode(WriteMode mode)
+{
+    writeMode = mode;
+}
+
+void Calculation::setThreadCount(int count)
+{
+    threadCount = qMax(1, count);
+}
+
+void Calculation::setStrict(bool value)
+{
+    strict = value;
+}
+
+void Calculation::setBagrovSolver(BagrovSolver solver)
+{
+    bagrovSolver = solver;
+}
+
+void Calculation::setDeduplicate(bool value)
 {
-    config = new Config();
+    deduplicate = value;
+}
+
+void Calculation::setPartitioned(bool value)
+{
+    partitioned = value;
+}
+
+void Calculation::setUsageTableFile(QString fileName)
+{
+    usageTableFile = fileName;
 }
 
 void Calculation::stop()
@@ -91,256 +136,93 @@ QString Calculation::getError()
 // =============================================================================
 bool Calculation::calc(QString fileOut, bool debug)
 {
-    // Current Abimo record (represents one row of the input dbf file)
-    abimoRecord record;
-
-    // variables for calculation
-    int index = 0;
-    
-    // Versiegelungsgrad Dachflaechen / sonst. versiegelte Flaechen / Strassen
-    // vegree of sealing of roof surfaces / other sealed surfaces / roads
-    float vgd, vgb, vgs;
-
-    // Kanalisierungsgrad Dachflaechen / sonst. versiegelte Flaechen / Strassen
-    // degree of canalization for roof surfaces / other sealed surfaces / roads
-    float kd, kb, ks;
-    
-    // Anteil der jeweiligen Belagsklasse
-    // share of respective pavement class
-    float bl1, bl2, bl3, bl4;
-
-    // Anteil der jeweiligen Strassenbelagsklasse
-    // share of respective road pavement class
-    float bls1, bls2, bls3, bls4;
-
-    // Gesamtflaeche Bebauung / Strasse
-    // total area of building development / road
-    float fb, fs;
-
-    // Verhaeltnis Bebauungsflaeche / Strassenflaeche zu Gesamtflaeche (ant = Anteil)
-    // share of building development area / road area to total area
-    float fbant, fsant;
-    
-    // Abflussvariablen der versiegelten Flaechen
-    // runoff variables of sealed surfaces
-    float row1, row2, row3, row4;
-    
-    // Infiltrationsvariablen der versiegelten Flaechen
-    // infiltration variables of sealed surfaces
-    float ri1, ri2, ri3, ri4;
-    
-    // Abfluss- / Infiltrationsvariablen der Dachflaechen
-    // runoff- / infiltration variables of roof surfaces
-    float rowd, rid;
-    
-    // Abfluss- / Infiltrationsvariablen unversiegelter Strassenflaechen
-    // runoff- / infiltration variables of unsealed road surfaces
-    float rowuvs, riuvs;
-    
-    // Infiltration unversiegelter Flaechen
-    // infiltratio of unsealed areas
-    float riuv;
-    
-    // float-Zwischenwerte
-    // float interm values
-    float r, ri, row;
-    int k;
+    int index;
 
     // count protocol entries
     counters.protcount = 0L;
     counters.keineFlaechenAngegeben = 0L;
     counters.nutzungIstNull = 0L;
+    counters.defaultedEG.clear();
+    counters.defaultedETP.clear();
+    counters.defaultedETPS.clear();
 
-    // first entry into protocol
-    DbaseWriter writer(fileOut, initValues);
+    // The parameters do not change during the calculation
+    parameters = KernelParameters(initValues);
+    parameters.strict = strict;
+    parameters.partitioned = partitioned;
+    parameters.bagrovSolver = bagrovSolver;
 
-    // get the number of rows in the input data ?
-    counters.totalRecRead = dbReader.getNumberOfRecords();
+    if (!usageTableFile.isEmpty()) {
 
-    // loop over all block partial areas (records) of input data
-    for (k = 0; k < counters.totalRecRead; k++) {
+        QString errorMessage = parameters.config.load(usageTableFile);
 
-        if (! weiter) {
-            protokollStream << "Berechnungen abgebrochen.\r\n";
-            return true;
+        if (!errorMessage.isEmpty()) {
+            protokollStream << "Error: " + errorMessage + "\r\n";
+            error = "Fehler beim Lesen der Nutzungstabelle.\n" + errorMessage;
+            return false;
         }
 
-        ptrDA.wIndex = index;
+        parameters.effectiveness.build(parameters.config, parameters.BERtoZero);
+    }
 
-        // Fill record with data from row k
-        dbReader.fillRecord(k, record, debug);
+    if (bagrovSolver == BagrovSolver::Table) {
 
-        // NUTZUNG = integer representing the type of area usage for each block partial area
-        if (record.NUTZUNG != 0) {
+        if (bagrovTable.isEmpty()) {
+            emit processSignal(0, "Erstelle Bagrov-Tabelle");
+            bagrovTable.build();
+        }
 
-            // CODE: unique identifier for each block partial area
+        parameters.bagrovTable = &bagrovTable;
 
-            // precipitation for entire year 'regenja' and for only summer season 'regenso'
-            regenja = record.REGENJA; /* Jetzt regenja,-so OK */
-            regenso = record.REGENSO;
+        protokollStream << "Bagrov-Tabelle: geschaetzte max. Abweichung von y = " +
+            QString::number(bagrovTable.getErrorEstimate()) + "\r\n";
+    }
 
-            // depth to groundwater table 'FLUR'
-            ptrDA.FLW = record.FLUR;
+    // first entry into protocol
+    DbaseWriter writer(fileOut, initValues, writeMode);
 
-            getNUTZ(
-                record.NUTZUNG,
-                record.TYP,      // structure type
-                record.FELD_30,  // field capacity [%] for 0- 30cm below ground level
-                record.FELD_150, // field capacity [%] for 0-150cm below ground level
-                record.CODE
-            );
+    // The field widths of streamed rows cannot grow with the values. CODE is
+    // as wide as in the input file.
+    if (writeMode == WriteMode::Stream) {
+        writer.setFieldWidths(dbReader.getBinding().CODE.width, OUTPUT_INTEGER_WIDTH);
+    }
 
-            /* cls_6a: an dieser Stelle muss garantiert werden, dass f30 und f150
-               als Parameter von getNUTZ einen definierten Wert erhalten und zwar 0.
-
-               FIXED: alle Werte sind definiert... wenn keine 0, sondern nichts bzw. Leerzeichen
-               angegeben wurden, wird nun eine 0 eingesetzt
-               aber eigentlich war das auch schon so ... ???
-            */
-
-            // Bagrov-calculation for sealed surfaces
-            getKLIMA(record.BEZIRK, record.CODE);
-
-            // share of roof area [%] 'PROBAU'
-            vgd = record.PROBAU_fraction;
-          
-            // share of other sealed areas (e.g. Hofflaechen) and calculate total sealed area
-            vgb = record.PROVGU_fraction;
-            ptrDA.VER = INT_ROUND(vgd * 100 + vgb * 100);
-            
-            // share of sealed road area
-            vgs = record.VGSTRASSE_fraction;
-          
-            // degree of canalization for roof / other sealed areas / sealed roads
-            kd = record.KAN_BEB_fraction;
-            kb = record.KAN_VGU_fraction;
-            ks = record.KAN_STR_fraction;
-          
-            // share of each pavement class for surfaces except roads of block area
-            bl1 = record.BELAG1_fraction;
-            bl2 = record.BELAG2_fraction;
-            bl3 = record.BELAG3_fraction;
-            bl4 = record.BELAG4_fraction;
-          
-            // share of each pavement class for roads of block area
-            bls1 = record.STR_BELAG1_fraction;
-            bls2 = record.STR_BELAG2_fraction;
-            bls3 = record.STR_BELAG3_fraction;
-            bls4 = record.STR_BELAG4_fraction;
-          
-            fb = record.FLGES;
-            fs = record.STR_FLGES;
-            
-            // if sum of total building development area and roads area is inconsiderably small
-            // it is assumed, that the area is unknown and 100 % building development area will be given by default
-            if (fb + fs < 0.0001)
-            {
-                //*protokollStream << "\r\nDie Flaeche des Elements " + record.CODE + " ist 0 \r\nund wird automatisch auf 100 gesetzt\r\n";
-                counters.protcount++;
-                counters.keineFlaechenAngegeben++;
-                fb = 100.0F;
-            }
+    if (!writer.open()) {
+        protokollStream << "Error: "+ writer.getError() +"\r\n";
+        error = "Fehler beim Schreiben der Ergebnisse.\n" + writer.getError();
+        return false;
+    }
 
-            // fbant = Verhaeltnis Bebauungsflaeche zu Gesamtflaeche
-            // fbant = ratio of building development area to total area
-            fbant = fb / (fb + fs);
-            
-            // fsant = Verhaeltnis Strassenflaeche zu Gesamtflaeche
-            // fsant = ratio of roads area to total area
-            fsant = fs / (fb + fs);
-
-            // Runoff for sealed surfaces
-            /* cls_1: Fehler a:
-               rowd = (1.0F - initValues.getInfdach()) * vgd * kb * fbant * RDV;
-               richtige Zeile folgt (kb ----> kd)
-            */
-            
-            /*  Legende der Abflussberechnung der 4 Belagsklassen bzw. Dachklasse:
-                rowd / rowx: Abfluss Dachflaeche / Abfluss Belagsflaeche x
-                infdach / infbelx: Infiltrationsparameter Dachfl. / Belagsfl. x
-                belx: Anteil Belagsklasse x
-                blsx: Anteil Strassenbelagsklasse x
-                vgd / vgb: Anteil versiegelte Dachfl. / sonstige versiegelte Flaeche zu Gesamtblockteilflaeche
-                kd / kb / ks: Grad der Kanalisierung Dach / sonst. vers. Fl. / Strassenflaechen
-                fbant / fsant: ?
-                RDV / RxV: Gesamtabfluss versiegelte Flaeche
-            */
-            rowd = (1.0F - initValues.getInfdach()) * vgd * kd * fbant * RDV;
-            row1 = (1.0F - initValues.getInfbel1()) * (bl1 * kb * vgb * fbant + bls1 * ks * vgs * fsant) * R1V;
-            row2 = (1.0F - initValues.getInfbel2()) * (bl2 * kb * vgb * fbant + bls2 * ks * vgs * fsant) * R2V;
-            row3 = (1.0F - initValues.getInfbel3()) * (bl3 * kb * vgb * fbant + bls3 * ks * vgs * fsant) * R3V;
-            row4 = (1.0F - initValues.getInfbel4()) * (bl4 * kb * vgb * fbant + bls4 * ks * vgs * fsant) * R4V;
-
-            // Infiltration for sealed surfaces
-            rid = (1 - kd) * vgd * fbant * RDV;
-            ri1 = (bl1 * vgb * fbant + bls1 * vgs * fsant) * R1V - row1;
-            ri2 = (bl2 * vgb * fbant + bls2 * vgs * fsant) * R2V - row2;
-            ri3 = (bl3 * vgb * fbant + bls3 * vgs * fsant) * R3V - row3;
-            ri4 = (bl4 * vgb * fbant + bls4 * vgs * fsant) * R4V - row4;
-            
-            // consider unsealed road surfaces as pavement class 4
-            rowuvs = 0.0F;                   /* old: 0.11F * (1-vgs) * fsant * R4V; */
-            riuvs = (1 - vgs) * fsant * R4V; /* old: 0.89F * (1-vgs) * fsant * R4V; */
-
-            // runoff for unsealed surfaces rowuv = 0
-            riuv = (100.0F - (float) ptrDA.VER) / 100.0F * RUV;
-
-            // calculate runoff 'row' for entire block patial area (FLGES+STR_FLGES)
-            row = (row1 + row2 + row3 + row4 + rowd + rowuvs); // mm/a
-            ptrDA.ROW = INT_ROUND(row);
-            
-            // calculate volume 'rowvol' from runoff
-            ROWVOL = row * 3.171F * (fb + fs) / 100000.0F;     // qcm/s
-            
-            // calculate infiltration rate 'ri' for entire block partial area
-            ri = (ri1 + ri2 + ri3 + ri4 + rid + riuvs + riuv); // mm/a
-            ptrDA.RI = INT_ROUND(ri);
-            
-            // calculate volume 'rivol' from infiltration rate
-            RIVOL = ri * 3.171F * (fb + fs) / 100000.0F;       // qcm/s
-            
-            // calculate total system losses 'r' due to runoff and infiltration for entire block partial area
-            r = row + ri;
-            ptrDA.R = INT_ROUND(r);
-            
-            // calculate volume of system losses 'rvol'due to runoff and infiltration
-            RVOL = ROWVOL + RIVOL;
-
-            // calculate total area of building development area as well as roads area
-            float flaeche1 = fb + fs;
-// cls_5b:
-            // calculate evaporation 'verdunst' by subtracting the sum of
-            // runoff and infiltration 'r' from precipitation of entire year
-            // 'regenja' multiplied by correction factor 'niedKorrFaktor'
-            float verdunst = (regenja * initValues.getNiedKorrF()) - r;
-
-            // write the calculated variables into respective fields
-            writer.addRecord();
-            writer.setRecordField("CODE", record.CODE);
-            writer.setRecordField("R", r);
-            writer.setRecordField("ROW", row);
-            writer.setRecordField("RI", ri);
-            writer.setRecordField("RVOL", RVOL);
-            writer.setRecordField("ROWVOL", ROWVOL);
-            writer.setRecordField("RIVOL", RIVOL);
-            writer.setRecordField("FLAECHE", flaeche1);
-// cls_5c:
-            writer.setRecordField("VERDUNSTUN", verdunst);
-
-            index++;
-        }
-        else {
-            counters.nutzungIstNull++;
+    // get the number of rows in the input data ?
+    counters.totalRecRead = dbReader.getNumberOfRecords();
 
-        }
+    // Loop over all block partial areas (records), either in this thread only,
+    // with reading and writing in threads of their own or with several
+    // calculating threads
+    if (threadCount > 1) {
+        index = calcParallel(writer, debug);
+    }
+    else {
+        index = pipelined ? calcPipelined(writer, debug) : calcSerial(writer, debug);
+    }
 
-        /* cls_2: Hier koennten falls gewuenscht die Flaechen dokumentiert werden,
-           deren NUTZUNG=NULL (siehe auch cls_3)
-        */
+    if (index < 0) {
+        writer.abort();
+        protokollStream << "Error: "+ dbReader.getError() +"\r\n";
+        error = "Fehler beim Lesen der Eingabedaten.\n" + dbReader.getError();
+        return false;
+    }
 
-        emit processSignal((int)((float) k / (float) counters.totalRecRead * 50.0), "Berechne");
+    if (! weiter) {
+        writer.abort();
+        protokollStream << "Berechnungen abgebrochen.\r\n";
+        return true;
     }
 
+    reportDefaultValues(protokollStream, counters, counters.defaultedEG, parameters.districtEG, "EG");
+    reportDefaultValues(protokollStream, counters, counters.defaultedETP, parameters.districtETP, "ETP");
+    reportDefaultValues(protokollStream, counters, counters.defaultedETPS, parameters.districtETPS, "ETPS");
+
     counters.totalRecWrite = index;
 
     emit processSignal(50, "Schreibe Ergebnisse.");
@@ -355,230 +237,523 @@ bool Calculation::calc(QString fileOut, bool debug)
 }
 
 // =============================================================================
-// FIXME:
+// Reads, calculates and writes the records one chunk after another, all in the
+// calling thread. Returns the number of written records or -1 if reading the
+// input data failed. Stops early if the calculation was cancelled.
 // =============================================================================
-void Calculation::getNUTZ(int nutz, int typ, int f30, int f150, QString code)
+int Calculation::calcSerial(DbaseWriter& writer, bool debug)
 {
-    // mittlere pot. kapillare Aufstiegsrate d. Sommerhalbjahres
-    float kr;
-
-    /*
-     * Feldlaengen von iTAS und inFK_S, L, T, U ;
-     * extern int lenTAS, lenS, lenL, lenT, lenU;
-     */
-
-    // declaration of yield power (ERT) and irrigation (BER) for agricultural or gardening purposes
-    setUsageYieldIrrigation(nutz, typ, code);
-
-    if (ptrDA.NUT != Usage::waterbody_G)
-    {
-        /* pot. Aufstiegshoehe TAS = FLUR - mittl. Durchwurzelungstiefe TWS */
-        TAS = ptrDA.FLW - config->getTWS(ptrDA.ERT, ptrDA.NUT);
-
-        /* Feldkapazitaet */
-        /* cls_6b: der Fall der mit NULL belegten FELD_30 und FELD_150 Werte
-           wird hier im erten Fall behandelt - ich erwarte dann den Wert 0 */
-        ptrDA.nFK = PDR::estimateWaterHoldingCapacity(f30, f150, ptrDA.NUT == Usage::forested_W);
-
-        /*
-         * mittlere pot. kapillare Aufstiegsrate kr (mm/d) des Sommerhalbjahres ;
-         * switch (bod) { case S: case U: case L: case T: case LO: case HN: } wird
-         * eingefuegt, wenn die Bodenart in das Zahlenmaterial aufgenommen wird vorlaeufig
-         * wird Sande angenommen ;
-         * Sande
-         */
-        kr = (TAS <= 0.0) ?
-            7.0F :
-            ijkr_S[
-                Helpers::index(TAS, iTAS, lenTAS) +
-                Helpers::index(ptrDA.nFK, inFK_S, lenS) * lenTAS
-            ];
-
-        /* mittlere pot. kapillare Aufstiegsrate kr (mm/d) des Sommerhalbjahres */
-        ptrDA.KR = (int) (PDR::estimateDaysOfGrowth(ptrDA.NUT, ptrDA.ERT) * kr);
-    }
-
-    if (initValues.getBERtoZero() && ptrDA.BER != 0) {
-        //*protokollStream << "Erzwinge BER=0 fuer Code: " << code << ", Wert war:" << ptrDA.BER << " \r\n";
-        counters.totalBERtoZeroForced++;
-        ptrDA.BER = 0;
+    // Required fields of a chunk of Abimo records (one row of the input dbf
+    // file each), converted to typed columns
+    abimoColumns input;
+    QVector<abimoOutputRecord> records;
+    ClimateCache cache;
+    RecordCache recordCache;
+    int count;
+    int index = 0;
+
+    // Index of the current record in the whole input data
+    int k = 0;
+
+    // Convert the input values chunk by chunk and loop over all block partial
+    // areas (records) of each chunk, KERNEL_BATCH_SIZE records at once
+    while ((count = dbReader.nextChunk(input, RECORDS_PER_CHUNK, debug)) > 0) {
+
+        for (int i = 0; i < count; i += KERNEL_BATCH_SIZE) {
+
+            if (! weiter) {
+                return index;
+            }
+
+            int n = qMin(KERNEL_BATCH_SIZE, count - i);
+
+            records.clear();
+            calcRecords(
+                input, i, n, parameters, cache,
+                deduplicate ? &recordCache : NULL, protokollStream, counters,
+                records
+            );
+
+            for (int j = 0; j < records.size(); j++) {
+                writer.addRecord(records.at(j));
+            }
+
+            index += records.size();
+            k += n;
+
+            emit processSignal((int)((float) k / (float) counters.totalRecRead * 50.0), "Berechne");
+        }
     }
+
+    return (count < 0) ? -1 : index;
 }
 
-void Calculation::setUsageYieldIrrigation(int usage, int type, QString code)
+// =============================================================================
+// Same as calcSerial() but reading and converting the input records as well as
+// converting the results to output rows are done in two threads of their own.
+// The three stages exchange chunks of records through queues holding at most
+// BATCHES_IN_FLIGHT chunks each, so that reading, calculating and writing
+// overlap. The calculation itself (and with it all access to the protocol and
+// all signals) stays in the calling thread.
+// =============================================================================
+int Calculation::calcPipelined(DbaseWriter& writer, bool debug)
 {
-    UsageResult result;
+    BoundedQueue<InputBatch> inputQueue(BATCHES_IN_FLIGHT);
+    BoundedQueue<OutputBatch> outputQueue(BATCHES_IN_FLIGHT);
+    std::atomic<bool> stopReading(false);
+
+    // Reader stage: an input batch with count <= 0 marks the end of the input
+    // (count < 0: reading failed)
+    std::thread reader([&]() {
+        InputBatch batch;
+        do {
+            batch = InputBatch();
+            batch.count = stopReading ?
+                0 : dbReader.nextChunk(batch.columns, RECORDS_PER_CHUNK, debug);
+            inputQueue.push(batch);
+        } while (batch.count > 0);
+    });
+
+    // Writer stage: an output batch with last = true marks the end
+    std::thread encoder([&]() {
+        OutputBatch batch;
+        do {
+            batch = outputQueue.pop();
+            for (int i = 0; i < batch.records.size(); i++) {
+                writer.addRecord(batch.records.at(i));
+            }
+        } while (! batch.last);
+    });
+
+    InputBatch input;
+    OutputBatch output;
+    ClimateCache cache;
+    RecordCache recordCache;
+    int index = 0;
 
-    result = config->getUsageResult(usage, type, code);
+    // Index of the current record in the whole input data
+    int k = 0;
 
-    if (result.tupleIndex < 0) {
-        protokollStream << result.message;
-        qDebug() << result.message;
-       abort();
-    }
+    while ((input = inputQueue.pop()).count > 0) {
 
-    if (!result.message.isEmpty()) {
-        protokollStream << result.message;
-        counters.protcount++;
+        output.records.clear();
+        output.records.reserve(input.count);
+
+        for (int i = 0; i < input.count && weiter; i += KERNEL_BATCH_SIZE) {
+
+            int n = qMin(KERNEL_BATCH_SIZE, input.count - i);
+
+            calcRecords(
+                input.columns, i, n, parameters, cache,
+                deduplicate ? &recordCache : NULL, protokollStream, counters,
+                output.records
+            );
+
+            k += n;
+
+            emit processSignal((int)((float) k / (float) counters.totalRecRead * 50.0), "Berechne");
+        }
+
+        index += output.records.size();
+        outputQueue.push(output);
+
+        // When cancelled, let the reader stop and skip what it still delivers
+        if (! weiter) {
+            stopReading = true;
+        }
     }
 
-    ptrDA.setUsageYieldIrrigation(config->getUsageTuple(result.tupleIndex));
+    output.records.clear();
+    output.last = true;
+    outputQueue.push(output);
+
+    reader.join();
+    encoder.join();
+
+    return (input.count < 0) ? -1 : index;
 }
 
 // =============================================================================
-// FIXME:
+// Calculates the chunks of records in threadCount threads. Each thread takes
+// the next chunk from the reader when it is done with the previous one and
+// calculates it with the (shared, read only) parameters, collecting protocol
+// messages, counters and cached climates of its own. The calling thread
+// writes the results (and the protocol messages) chunk by chunk in the order
+// of the input, so that the output is the same as with calcSerial(). The
+// counters of the threads are added up at the end.
 // =============================================================================
-void Calculation::getKLIMA(int bez, QString code)
+int Calculation::calcParallel(DbaseWriter& writer, bool debug)
 {
-    // Effektivitaetsparameter
-    float bag;
+    // Guards reading from dbReader and the number of chunks read so far
+    QMutex readMutex;
+    int chunksRead = 0;
+
+    // Guard the calculated chunks and the number of chunks (known at the end)
+    QMutex resultMutex;
+    QWaitCondition chunkDone;
+    QHash<int, ChunkResult> results;
+    int chunkCount = -1;
+    bool readFailed = false;
+
+    // Limits the number of chunks that are calculated but not yet written
+    QSemaphore permits(CHUNKS_AHEAD_PER_THREAD * threadCount);
+    std::atomic<bool> stopWorkers(false);
+
+    // Counters of each thread (all zero at first)
+    std::vector<Counters> workerCounters(threadCount);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threadCount; t++) {
+        workers.emplace_back([&, t]() {
+
+            QString protocol;
+            QTextStream stream(&protocol);
+            Counters& own = workerCounters[t];
+            ClimateCache cache;
+            RecordCache recordCache;
+            abimoColumns input;
+
+            while (true) {
+
+                permits.acquire();
+
+                if (stopWorkers) {
+                    break;
+                }
+
+                ChunkResult result;
+                int chunk;
+
+                {
+                    QMutexLocker locker(&readMutex);
+                    chunk = chunksRead++;
+                    result.count = dbReader.nextChunk(input, RECORDS_PER_CHUNK, debug);
+                }
+
+                // The first chunk without records marks the end of the input
+                if (result.count <= 0) {
+                    QMutexLocker locker(&resultMutex);
+                    if (chunkCount < 0 || chunk < chunkCount) {
+                        chunkCount = chunk;
+                    }
+                    readFailed = readFailed || result.count < 0;
+                    chunkDone.wakeAll();
+                    break;
+                }
+
+                result.records.reserve(result.count);
+
+                for (int i = 0; i < result.count; i += KERNEL_BATCH_SIZE) {
+                    calcRecords(
+                        input, i, qMin(KERNEL_BATCH_SIZE, result.count - i),
+                        parameters, cache, deduplicate ? &recordCache : NULL,
+                        stream, own, result.records
+                    );
+                }
+
+                stream.flush();
+                result.protocol = protocol;
+                protocol.clear();
+
+                QMutexLocker locker(&resultMutex);
+                results.insert(chunk, result);
+                chunkDone.wakeAll();
+            }
+        });
+    }
 
-    // ep = potential evaporation
-    float ep;
+    ChunkResult result;
+    int index = 0;
 
-    // prepcipitation at ground level
-    float p;
+    // Index of the current record in the whole input data
+    int k = 0;
 
-    // ratio of precipitation to potential evaporation
-    float x;
+    for (int chunk = 0; weiter; chunk++) {
 
-    // ratio of real evaporation to potential evaporation
-    float y;
+        {
+            QMutexLocker locker(&resultMutex);
 
-    // real evapotranspiration
-    float etr;
+            while (!results.contains(chunk) && (chunkCount < 0 || chunk < chunkCount)) {
+                chunkDone.wait(&resultMutex);
+            }
 
-    /*
-     * spaeter zeizusaetzliche Parameter Hier ;
-     * ptrDA.P1 = p1;
-     * * ptrDA.PS = ps;
-     */
-    ptrDA.P1 = regenja;
-    ptrDA.P1S = regenso;
+            if (!results.contains(chunk)) {
+                break;
+            }
 
-    // parameter for the city districts
-    if (ptrDA.NUT == Usage::waterbody_G)
-    {
-        ptrDA.ETP = initValueOrReportedDefaultValue(
-            bez, code, initValues.hashEG, 775, "EG"
-        );
+            result = results.take(chunk);
+        }
+
+        protokollStream << result.protocol;
+
+        for (int i = 0; i < result.records.size(); i++) {
+            writer.addRecord(result.records.at(i));
+        }
+
+        index += result.records.size();
+        k += result.count;
+        permits.release();
+
+        emit processSignal((int)((float) k / (float) counters.totalRecRead * 50.0), "Berechne");
     }
-    else
-    {
-        ptrDA.ETP = initValueOrReportedDefaultValue(
-            bez, code, initValues.hashETP, 660, "ETP"
-        );
 
-        ptrDA.ETPS = initValueOrReportedDefaultValue(
-            bez, code, initValues.hashETPS, 530, "ETPS"
-        );
+    // Let waiting threads see that they are done (also when cancelled)
+    stopWorkers = true;
+    permits.release(threadCount);
+
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
     }
 
-    // declaration potential evaporation ep and precipitation p
-    ep = (float) ptrDA.ETP; /* Korrektur mit 1.1 gestrichen */
-    p = (float) ptrDA.P1 * initValues.getNiedKorrF(); /* ptrDA.KF */
+    for (size_t t = 0; t < workerCounters.size(); t++) {
+        counters.protcount += workerCounters[t].protcount;
+        counters.keineFlaechenAngegeben += workerCounters[t].keineFlaechenAngegeben;
+        counters.nutzungIstNull += workerCounters[t].nutzungIstNull;
+        counters.totalBERtoZeroForced += workerCounters[t].totalBERtoZeroForced;
 
-    /*
-     * Berechnung der Abfluesse RDV und R1V bis R4V fuer versiegelte
-     * Teilflaechen und unterschiedliche Bagrovwerte ND und N1 bis N4
-     */
+        const Counters& own = workerCounters[t];
 
-    // ratio precipitation to potential evaporation
-    x = p / ep;
+        for (auto it = own.defaultedEG.constBegin(); it != own.defaultedEG.constEnd(); ++it) {
+            counters.defaultedEG[it.key()] += it.value();
+        }
 
-    Bagrov bagrov;
+        for (auto it = own.defaultedETP.constBegin(); it != own.defaultedETP.constEnd(); ++it) {
+            counters.defaultedETP[it.key()] += it.value();
+        }
 
-    /* Berechnung des Abflusses RxV fuer versiegelte Teilflaechen mittels
-       Umrechnung potentieller Verdunstungen ep zu realen über Umrechnungsfaktor y und
-       subtrahiert von Niederschlag p */
+        for (auto it = own.defaultedETPS.constBegin(); it != own.defaultedETPS.constEnd(); ++it) {
+            counters.defaultedETPS[it.key()] += it.value();
+        }
+    }
+
+    return readFailed ? -1 : index;
+}
+
+// =============================================================================
+// Calculates the records first to first + count - 1 (at most KERNEL_BATCH_SIZE)
+// of the given chunk of input records, reports to the given stream and counters
+// and appends the results to records. Records with NUTZUNG = 0 are skipped.
+//
+// With a recordCache, only records whose key (see RecordKey) is neither in the
+// cache nor the same as the key of a record before them are calculated. All
+// other records get the results of the record with the same key, with volumes
+// for their own area.
+// =============================================================================
+void Calculation::calcRecords(
+    const abimoColumns& input, int first, int count,
+    const KernelParameters& parameters, ClimateCache& cache,
+    RecordCache* recordCache, QTextStream& stream, Counters& counters,
+    QVector<abimoOutputRecord>& records
+)
+{
+    KernelBatch batch;
+    abimoOutputRecord record;
+
+    if (recordCache == NULL) {
+
+        CalculationKernel::calculateBatch(input, first, count, parameters, cache, batch);
 
-    RDV = p - bagrov.nbagro(initValues.getBagdach(), x) * ep;
-    R1V = p - bagrov.nbagro(initValues.getBagbel1(), x) * ep;
-    R2V = p - bagrov.nbagro(initValues.getBagbel2(), x) * ep;
-    R3V = p - bagrov.nbagro(initValues.getBagbel3(), x) * ep;
-    R4V = p - bagrov.nbagro(initValues.getBagbel4(), x) * ep;
+        for (int j = 0; j < count; j++) {
 
-    // Calculate runoff RUV for unsealed partial surfaces
-    if (ptrDA.NUT == Usage::waterbody_G)
-    {
-        RUV = p - ep;
+            report(stream, counters, batch.flags[j], input, first + j, parameters);
+
+            if (CalculationKernel::isCalculated(batch.flags[j])) {
+                CalculationKernel::getRecord(input, first, j, batch, record);
+                records.append(record);
+            }
+        }
+
+        return;
     }
-    else
-    {
-        // Determine effectiveness parameter bag for unsealed surfaces
-        bag = EffectivenessUnsealed::getNUV(ptrDA); /* Modul Raster abgespeckt */
 
-        if (ptrDA.P1S > 0 && ptrDA.ETPS > 0) {
-            bag *= getSummerModificationFactor(
-                (float) (ptrDA.P1S + ptrDA.BER + ptrDA.KR) / ptrDA.ETPS
-            );
+    RecordKey keys[KERNEL_BATCH_SIZE];
+    RecordResult results[KERNEL_BATCH_SIZE];
+
+    // Lane of the batch in which each record is calculated (-1: cached)
+    int lanes[KERNEL_BATCH_SIZE];
+
+    // Records to be calculated
+    int pending[KERNEL_BATCH_SIZE];
+    int n = 0;
+
+    for (int j = 0; j < count; j++) {
+
+        keys[j] = CalculationKernel::getKey(input, first + j, parameters);
+        lanes[j] = -1;
+
+        if (recordCache->lookup(keys[j], results[j])) {
+            continue;
         }
 
-        // Calculate the x-factor of bagrov relation: x = (P + KR + BER)/ETP
-        // Then get the y-factor: y = fbag(n, x)
-        y = bagrov.nbagro(bag, (p + ptrDA.KR + ptrDA.BER) / ep);
+        for (int k = 0; k < n && lanes[j] < 0; k++) {
+            if (keys[pending[k]] == keys[j]) {
+                lanes[j] = k;
+            }
+        }
+
+        if (lanes[j] < 0) {
+            lanes[j] = n;
+            pending[n++] = j;
+        }
+    }
+
+    if (n == count) {
+        CalculationKernel::calculateBatch(input, first, count, parameters, cache, batch);
+    }
+    else if (n > 0) {
+        abimoColumns compact;
+        gather(input, first, pending, n, compact);
+        CalculationKernel::calculateBatch(compact, 0, n, parameters, cache, batch);
+    }
+
+    for (int k = 0; k < n; k++) {
+        recordCache->insert(keys[pending[k]], CalculationKernel::getResult(batch, k));
+    }
+
+    for (int j = 0; j < count; j++) {
+
+        if (lanes[j] >= 0) {
+            results[j] = CalculationKernel::getResult(batch, lanes[j]);
+        }
 
-        // Get the real evapotransporation using estimated y-factor
-        etr = y * ep;
+        report(stream, counters, results[j].flags, input, first + j, parameters);
 
-        if (TAS < 0) {
-            etr += (ep - y * ep) * (float) exp(ptrDA.FLW / TAS);
+        if (CalculationKernel::isCalculated(results[j].flags)) {
+            CalculationKernel::getRecord(input, first + j, results[j], parameters, record);
+            records.append(record);
         }
+    }
+}
 
-        RUV = p - etr;
+// Copy the records first + indices[k] (k = 0 to n - 1) of input to output
+void Calculation::gather(
+    const abimoColumns& input, int first, const int* indices, int n,
+    abimoColumns& output
+)
+{
+    for (int k = 0; k < n; k++) {
+
+        int i = first + indices[k];
+
+        output.NUTZUNG.append(input.NUTZUNG.at(i));
+        output.CODE.append(input.CODE.at(i));
+        output.REGENJA.append(input.REGENJA.at(i));
+        output.REGENSO.append(input.REGENSO.at(i));
+        output.FLUR.append(input.FLUR.at(i));
+        output.TYP.append(input.TYP.at(i));
+        output.FELD_30.append(input.FELD_30.at(i));
+        output.FELD_150.append(input.FELD_150.at(i));
+        output.BEZIRK.append(input.BEZIRK.at(i));
+        output.PROBAU_fraction.append(input.PROBAU_fraction.at(i));
+        output.PROVGU_fraction.append(input.PROVGU_fraction.at(i));
+        output.VGSTRASSE_fraction.append(input.VGSTRASSE_fraction.at(i));
+        output.KAN_BEB_fraction.append(input.KAN_BEB_fraction.at(i));
+        output.KAN_VGU_fraction.append(input.KAN_VGU_fraction.at(i));
+        output.KAN_STR_fraction.append(input.KAN_STR_fraction.at(i));
+        output.BELAG1_fraction.append(input.BELAG1_fraction.at(i));
+        output.BELAG2_fraction.append(input.BELAG2_fraction.at(i));
+        output.BELAG3_fraction.append(input.BELAG3_fraction.at(i));
+        output.BELAG4_fraction.append(input.BELAG4_fraction.at(i));
+        output.STR_BELAG1_fraction.append(input.STR_BELAG1_fraction.at(i));
+        output.STR_BELAG2_fraction.append(input.STR_BELAG2_fraction.at(i));
+        output.STR_BELAG3_fraction.append(input.STR_BELAG3_fraction.at(i));
+        output.STR_BELAG4_fraction.append(input.STR_BELAG4_fraction.at(i));
+        output.FLGES.append(input.FLGES.at(i));
+        output.STR_FLGES.append(input.STR_FLGES.at(i));
     }
 }
 
-float Calculation::initValueOrReportedDefaultValue(
-    int bez, QString code, QHash<int, int> &hash, int defaultValue, QString name
+// =============================================================================
+// Writes the protocol messages and counts the events that the kernel reported
+// for record i (see CalculationKernel::Flag). Aborts if no usage is defined
+// for the record.
+// =============================================================================
+void Calculation::report(
+    QTextStream& stream, Counters& counters, int flags,
+    const abimoColumns& input, int i, const KernelParameters& parameters
 )
 {
-    if (hash.contains(bez)) {
-        //take from xml
-        return hash.value(bez);
+    if (flags & CalculationKernel::NUTZUNG_IS_ZERO) {
+        counters.nutzungIstNull++;
+        return;
+    }
+
+    if (flags & (CalculationKernel::USAGE_UNDEFINED | CalculationKernel::TYPE_DEFAULTED)) {
+
+        UsageResult result = parameters.config.getUsageResult(
+            input.NUTZUNG.at(i), input.TYP.at(i), input.CODE.at(i)
+        );
+
+        stream << result.message;
+
+        if (flags & CalculationKernel::USAGE_UNDEFINED) {
+            TRACE_ERROR(result.message);
+            abort();
+        }
+
+        counters.protcount++;
     }
 
-    //default
-    float result = hash.contains(0) ? hash.value(0) : defaultValue;
+    if (flags & CalculationKernel::BER_SET_TO_ZERO) {
+        //stream << "Erzwinge BER=0 fuer Code: " << code << " \r\n";
+        counters.totalBERtoZeroForced++;
+    }
 
-    QString bezString;
-    bezString.setNum(bez);
+    int bez = input.BEZIRK.at(i);
 
-    QString string;
-    string.setNum(result);
+    // Reported per district at the end of the calculation
+    if (flags & CalculationKernel::EG_DEFAULTED) {
+        counters.defaultedEG[bez]++;
+    }
+
+    if (flags & CalculationKernel::ETP_DEFAULTED) {
+        counters.defaultedETP[bez]++;
+    }
 
-    protokollStream << "\r\n" + name + " unbekannt fuer " + code +
-        " von Bezirk " + bezString + "\r\n" + name +
-        "=" + string + " angenommen\r\n";
-    counters.protcount++;
+    if (flags & CalculationKernel::ETPS_DEFAULTED) {
+        counters.defaultedETPS[bez]++;
+    }
 
-    return result;
+    if (flags & CalculationKernel::AREA_DEFAULTED) {
+        //stream << "\r\nDie Flaeche des Elements " + code + " ist 0 \r\nund wird automatisch auf 100 gesetzt\r\n";
+        counters.protcount++;
+        counters.keineFlaechenAngegeben++;
+    }
 }
 
 // =============================================================================
-// Get factor to be applied for "summer"
+// Writes one protocol message per district in which the value (EG, ETP or
+// ETPS) was unknown for any records, with the number of these records
 // =============================================================================
-float Calculation::getSummerModificationFactor(float wa)
+void Calculation::reportDefaultValues(
+    QTextStream& stream, Counters& counters, const QMap<int, long>& districts,
+    const DistrictValues& values, QString name
+)
 {
-    const float watab[] =
-    {
-        0.45F, 0.50F, 0.55F, 0.60F, 0.65F, 0.70F, 0.75F, // 0 ..  6
-        0.80F, 0.85F, 0.90F, 0.95F, 1.00F, 1.05F, 1.10F  // 7 .. 13
-    };
-
-    const float Ftab[] =
-    {
-        0.65F, 0.75F, 0.82F, 0.90F, 1.00F, 1.06F, 1.15F, // 0 ..  6
-        1.22F, 1.30F, 1.38F, 1.47F, 1.55F, 1.63F, 1.70F  // 7 .. 13
-    };
-
-    return Helpers::interpolate(wa, watab, Ftab, 14);
+    bool defaulted;
+
+    for (auto it = districts.constBegin(); it != districts.constEnd(); ++it) {
+
+        QString bezString;
+        bezString.setNum(it.key());
+
+        QString string;
+        string.setNum(values.get(it.key(), defaulted));
+
+        stream << "\r\n" + name + " unbekannt fuer " +
+            QString::number(it.value()) + " Elemente von Bezirk " +
+            bezString + "\r\n" + name + "=" + string + " angenommen\r\n";
+        counters.protcount++;
+    }
 }
 
-void Calculation::calculate(QString inputFile, QString configFile, QString outputFile, bool debug)
+void Calculation::calculate(
+    QString inputFile, QString configFile, QString outputFile,
+    bool debug, bool pipelined, WriteMode writeMode, int threadCount
+)
 {
     // Open the input file and read the raw (text) values into the dbReader object
-    DbaseReader dbReader(inputFile);
+    DbaseReader dbReader(inputFile, ReadMode::Mapped);
 
     if (!dbReader.checkAndRead()) {
         abort();
@@ -588,14 +763,14 @@ void Calculation::calculate(QString inputFile, QString configFile, QString outpu
     InitValues initValues;
 
     if (configFile.isEmpty()) {
-        qDebug() << "No config file given -> Using default values";
+        TRACE_INFO("No config file given -> Using default values");
     }
     else {
-        qDebug() << "Using configuration file:" << configFile;
+        TRACE_INFO("Using configuration file:" << configFile);
 
         QString errorMessage = InitValues::updateFromConfig(initValues, configFile);
         if (!errorMessage.isEmpty()) {
-            qDebug() << "Error in updateFromConfig: " << errorMessage;
+            TRACE_ERROR("Error in updateFromConfig: " << errorMessage);
             abort();
         }
     }
@@ -606,11 +781,14 @@ void Calculation::calculate(QString inputFile, QString configFile, QString outpu
     QTextStream logStream(&logHandle);
 
     Calculation calculator(dbReader, initValues, logStream);
+    calculator.setPipelined(pipelined);
+    calculator.setWriteMode(writeMode);
+    calculator.setThreadCount(threadCount);
 
     bool success = calculator.calc(outputFile, debug);
 
     if (!success) {
-        qDebug() << "Error in calc(): " << calculator.getError();
+        TRACE_ERROR("Error in calc(): " << calculator.getError());
         abort();
     }
 
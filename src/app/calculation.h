@@ -6,11 +6,15 @@
 #ifndef CALCULATION_H
 #define CALCULATION_H
 
+#include <QMap>
 #include <QObject>
 #include <QString>
 #include <QTextStream>
 
+#include "bagrovTable.h"
+#include "calculationKernel.h"
 #include "dbaseReader.h"
+#include "dbaseWriter.h"
 #include "initvalues.h"
 #include "config.h"
 
@@ -31,6 +35,11 @@ struct Counters {
 
     // Anzahl der Protokolleintraege
     long protcount;
+
+    // Anzahl der Elemente je Bezirk, fuer die EG, ETP bzw. ETPS unbekannt ist
+    QMap<int, long> defaultedEG;
+    QMap<int, long> defaultedETP;
+    QMap<int, long> defaultedETPS;
 };
 
 class Calculation: public QObject
@@ -45,65 +54,88 @@ public:
     long getNutzungIstNull();
     Counters getCounters();
     QString getError();
+    void setPipelined(bool value);
+    void setWriteMode(WriteMode mode);
+    void setThreadCount(int count);
+    void setStrict(bool value);
+    void setBagrovSolver(BagrovSolver solver);
+    void setUsageTableFile(QString fileName);
+    void setDeduplicate(bool value);
+    void setPartitioned(bool value);
     void stop();
-    static void calculate(QString inputFile, QString configFile, QString outputFile, bool debug = false);
+    static void calculate(
+        QString inputFile, QString configFile, QString outputFile,
+        bool debug = false, bool pipelined = false,
+        WriteMode writeMode = WriteMode::Collect, int threadCount = 1
+    );
 
 signals:
     void processSignal(int, QString);
 
 private:
-    Config *config;
-    const static float iTAS[];
-    const static float inFK_S[];
-    const static float ijkr_S[];
     InitValues & initValues;
     QTextStream & protokollStream;
     DbaseReader & dbReader;
-    PDR ptrDA;
     QString error;
 
-    // ******vorlaeufig aus Teilblock 0 wird fuer die Folgeblocks genommen
-    float regenja, regenso;
+    // parameters of the calculation, taken from initValues when calc() starts
+    KernelParameters parameters;
 
-    // Abfluesse nach Bagrov fuer N1 bis N4
-    float RDV, R1V, R2V, R3V, R4V;
+    Counters counters;
 
-    float RUV;
+    // to stop calc
+    bool weiter;
 
-    // Regenwasserabfluss in Qubikzentimeter pro Sekunde
-    float ROWVOL;
+    // read, calculate and write in three overlapping threads
+    bool pipelined;
 
-    // unterirdischer Gesamtabfluss in qcm/s
-    float RIVOL;
+    // how the results are written to the output file
+    WriteMode writeMode;
 
-    // Gesamtabfluss in qcm/s
-    float RVOL;
+    // number of threads that calculate chunks of records in parallel
+    int threadCount;
 
-    // potentielle Aufstiegshoehe
-    float TAS;
+    // results exactly as with the scalar calculation (see KernelParameters)
+    bool strict;
 
-    // Feldlaenge von iTAS
-    int lenTAS;
+    // how the Bagrov relation of the unsealed surfaces is solved
+    BagrovSolver bagrovSolver;
 
-    // Feldlaenge von inFK_S
-    int lenS;
+    // built when first needed, then kept for further calculations
+    BagrovTable bagrovTable;
 
-    Counters counters;
+    // file with the assignment of usage and type to (usage, yield,
+    // irrigation), empty: built-in assignment (see Config::load())
+    QString usageTableFile;
 
-    // to stop calc
-    bool weiter;
+    // calculate records with the same input values (except for code and
+    // area) only once (see RecordCache)
+    bool deduplicate;
+
+    // prepare the records grouped by usage (see KernelParameters)
+    bool partitioned;
 
     // functions
-    float getNUV(PDR &B);
-    float getSummerModificationFactor(float wa);
-    float getG02 (int nFK);
-    void getNUTZ(int nutz, int typ, int f30, int f150, QString code);
-    void setUsageYieldIrrigation(int usage, int type, QString code);
-    void logNotDefined(QString code, int type);
-    void getKLIMA(int bez, QString codestr);
-    float initValueOrReportedDefaultValue(
-        int bez, QString code, QHash<int, int> &hash, int defaultValue,
-        QString name
+    int calcSerial(DbaseWriter& writer, bool debug);
+    int calcPipelined(DbaseWriter& writer, bool debug);
+    int calcParallel(DbaseWriter& writer, bool debug);
+    static void calcRecords(
+        const abimoColumns& input, int first, int count,
+        const KernelParameters& parameters, ClimateCache& cache,
+        RecordCache* recordCache, QTextStream& stream, Counters& counters,
+        QVector<abimoOutputRecord>& records
+    );
+    static void gather(
+        const abimoColumns& input, int first, const int* indices, int n,
+        abimoColumns& output
+    );
+    static void report(
+        QTextStream& stream, Counters& counters, int flags,
+        const abimoColumns& input, int i, const KernelParameters& parameters
+    );
+    static void reportDefaultValues(
+        QTextStream& stream, Counters& counters, const QMap<int, long>& districts,
+        const DistrictValues& values, QString name
     );
 };
 
@@ -0,0 +1,1087 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#include <math.h>
+#include <string.h>
+#include <QHash>
+#include <QString>
+
+#include "bagrov.h"
+#include "bagrovTable.h"
+#include "calculationKernel.h"
+#include "config.h"
+#include "constants.h"
+#include "effectivenessunsealed.h"
+#include "helpers.h"
+#include "initvalues.h"
+#include "pdr.h"
+
+// potential ascent rate TAS (column labels for matrix 'CalculationKernel::ijkr_S')
+constexpr float CalculationKernel::iTAS[] = {
+    0.1F, 0.2F, 0.3F, 0.4F, 0.5F, 0.6F, 0.7F, 0.8F,
+    0.9F, 1.0F, 1.2F, 1.4F, 1.7F, 2.0F, 2.3F
+};
+
+// soil type unknown - default soil type used in the following: sand
+
+// Usable field capacity nFK (row labels for matrix 'CalculationKernel::ijkr_S')
+constexpr float CalculationKernel::inFK_S[] = {
+    8.0F, 9.0F, 14.0F, 14.5F, 15.5F, 17.0F, 20.5F
+};
+
+/* Mean potential capillary rise rate kr [mm/d] of a summer season depending on:
+ * potential ascent rate TAS (one column each) and
+ * usable field capacity nFK (one row each) */
+constexpr float CalculationKernel::ijkr_S[] = {
+    7.0F, 6.0F, 5.0F, 1.5F, 0.5F, 0.2F, 0.1F, 0.0F, 0.0F, 0.0F,  0.0F , 0.0F, 0.0F , 0.0F, 0.0F,
+    7.0F, 7.0F, 6.0F, 5.0F, 3.0F, 1.2F, 0.5F, 0.2F, 0.1F, 0.0F,  0.0F , 0.0F, 0.0F , 0.0F, 0.0F,
+    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 3.0F, 1.5F, 0.7F, 0.3F, 0.15F, 0.1F , 0.0F, 0.0F , 0.0F, 0.0F,
+    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 3.0F, 2.0F, 1.0F, 0.7F, 0.4F,  0.15F, 0.1F, 0.0F , 0.0F, 0.0F,
+    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 4.5F, 2.5F, 1.5F, 0.7F, 0.4F,  0.15F, 0.1F, 0.0F , 0.0F, 0.0F,
+    7.0F, 7.0F, 6.0F, 6.0F, 5.0F, 5.0F, 3.5F, 2.0F, 1.5F, 0.8F,  0.3F , 0.1F, 0.05F, 0.0F, 0.0F,
+    7.0F, 7.0F, 6.0F, 6.0F, 6.0F, 5.0F, 5.0F, 5.0F, 3.0F, 2.0F,  1.0F , 0.5F, 0.15F, 0.0F, 0.0F
+};
+
+KernelParameters::KernelParameters():
+    infdach(0), infbel1(0), infbel2(0), infbel3(0), infbel4(0),
+    bagdach(0), bagbel1(0), bagbel2(0), bagbel3(0), bagbel4(0),
+    niedKorrF(0),
+    BERtoZero(false),
+    summer(true),
+    strict(true),
+    partitioned(false),
+    bagrovSolver(BagrovSolver::Legacy),
+    bagrovTable(NULL)
+{
+}
+
+KernelParameters::KernelParameters(InitValues& initValues):
+    infdach(initValues.getInfdach()),
+    infbel1(initValues.getInfbel1()),
+    infbel2(initValues.getInfbel2()),
+    infbel3(initValues.getInfbel3()),
+    infbel4(initValues.getInfbel4()),
+    bagdach(initValues.getBagdach()),
+    bagbel1(initValues.getBagbel1()),
+    bagbel2(initValues.getBagbel2()),
+    bagbel3(initValues.getBagbel3()),
+    bagbel4(initValues.getBagbel4()),
+    niedKorrF(initValues.getNiedKorrF()),
+    BERtoZero(initValues.getBERtoZero()),
+    summer(!initValues.districtETPS.isZero()),
+    strict(true),
+    partitioned(false),
+    bagrovSolver(BagrovSolver::Legacy),
+    bagrovTable(NULL),
+    districtETP(initValues.districtETP),
+    districtETPS(initValues.districtETPS),
+    districtEG(initValues.districtEG)
+{
+    effectiveness.build(config, BERtoZero);
+}
+
+CalculationKernel::CalculationKernel()
+{
+}
+
+ClimateCache::ClimateCache()
+{
+}
+
+bool ClimateCache::lookup(int precipitation, int etp, SealedRunoffs& runoffs) const
+{
+    QHash<quint64, SealedRunoffs>::const_iterator it = entries.constFind(
+        key(precipitation, etp)
+    );
+
+    if (it == entries.constEnd()) {
+        return false;
+    }
+
+    runoffs = it.value();
+
+    return true;
+}
+
+void ClimateCache::insert(int precipitation, int etp, const SealedRunoffs& runoffs)
+{
+    // Many different climates (e.g. interpolated precipitation): stop caching
+    if (entries.size() < MAX_CLIMATES) {
+        entries.insert(key(precipitation, etp), runoffs);
+    }
+}
+
+Bagrov& ClimateCache::getSealedBagrov()
+{
+    return sealedBagrov;
+}
+
+Bagrov& ClimateCache::getUnsealedBagrov()
+{
+    return unsealedBagrov;
+}
+
+quint64 ClimateCache::key(int precipitation, int etp)
+{
+    return ((quint64) (quint32) precipitation << 32) | (quint32) etp;
+}
+
+bool RecordKey::operator==(const RecordKey& other) const
+{
+    return memcmp(values, other.values, sizeof(values)) == 0;
+}
+
+uint qHash(const RecordKey& key, uint seed)
+{
+    return qHashBits(key.values, sizeof(key.values), seed);
+}
+
+RecordCache::RecordCache()
+{
+}
+
+bool RecordCache::lookup(const RecordKey& key, RecordResult& result) const
+{
+    QHash<RecordKey, RecordResult>::const_iterator it = entries.constFind(key);
+
+    if (it == entries.constEnd()) {
+        return false;
+    }
+
+    result = it.value();
+
+    return true;
+}
+
+void RecordCache::insert(const RecordKey& key, const RecordResult& result)
+{
+    // Hardly any equal records: stop caching
+    if (entries.size() < MAX_RECORDS) {
+        entries.insert(key, result);
+    }
+}
+
+// =============================================================================
+// Calculates the results of record i of the given chunk of input records into
+// record. Returns a combination of flags (see CalculationKernel::Flag). The
+// record is only calculated if neither NUTZUNG_IS_ZERO nor USAGE_UNDEFINED is
+// set.
+// =============================================================================
+int CalculationKernel::calculate(
+    const abimoColumns& input, int i, const KernelParameters& parameters,
+    abimoOutputRecord& record
+)
+{
+    ClimateCache cache;
+    KernelBatch batch;
+
+    calculateBatch(input, i, 1, parameters, cache, batch);
+
+    if (isCalculated(batch.flags[0])) {
+        getRecord(input, i, 0, batch, record);
+    }
+
+    return batch.flags[0];
+}
+
+// =============================================================================
+// Calculates the records first to first + count - 1 (count must not exceed
+// KERNEL_BATCH_SIZE). Usage and climate are determined record by record, the
+// Bagrov relation of the unsealed surfaces is then solved and the runoff and
+// infiltration of the surfaces are calculated for all records at once.
+//
+// The settings strict, BERtoZero and summer do not change during a
+// calculation. They are checked here once per batch, the version of the kernel
+// for them then has no branches on them (see KernelPolicy).
+// =============================================================================
+void CalculationKernel::calculateBatch(
+    const abimoColumns& input, int first, int count,
+    const KernelParameters& parameters, ClimateCache& cache, KernelBatch& batch
+)
+{
+    // Select the version of the kernel for the settings of the calculation
+    int policy =
+        (parameters.strict ? 4 : 0) +
+        (parameters.BERtoZero ? 2 : 0) +
+        (parameters.summer ? 1 : 0);
+
+    switch (policy) {
+        case 0:
+            calculateBatchWith<KernelPolicy<false, false, false>>(input, first, count, parameters, cache, batch);
+            break;
+        case 1:
+            calculateBatchWith<KernelPolicy<false, false, true>>(input, first, count, parameters, cache, batch);
+            break;
+        case 2:
+            calculateBatchWith<KernelPolicy<false, true, false>>(input, first, count, parameters, cache, batch);
+            break;
+        case 3:
+            calculateBatchWith<KernelPolicy<false, true, true>>(input, first, count, parameters, cache, batch);
+            break;
+        case 4:
+            calculateBatchWith<KernelPolicy<true, false, false>>(input, first, count, parameters, cache, batch);
+            break;
+        case 5:
+            calculateBatchWith<KernelPolicy<true, false, true>>(input, first, count, parameters, cache, batch);
+            break;
+        case 6:
+            calculateBatchWith<KernelPolicy<true, true, false>>(input, first, count, parameters, cache, batch);
+            break;
+        default:
+            calculateBatchWith<KernelPolicy<true, true, true>>(input, first, count, parameters, cache, batch);
+    }
+}
+
+// calculateBatch() for the settings given by Policy (see KernelPolicy), which
+// must be those of the parameters
+template <class Policy>
+void CalculationKernel::calculateBatchWith(
+    const abimoColumns& input, int first, int count,
+    const KernelParameters& parameters, ClimateCache& cache, KernelBatch& batch
+)
+{
+    Q_ASSERT(count <= KERNEL_BATCH_SIZE);
+
+    if (parameters.partitioned) {
+        preparePartitioned<Policy>(input, first, count, parameters, cache, batch);
+    }
+    else {
+        for (int j = 0; j < count; j++) {
+            batch.flags[j] = prepare<Usage::unknown, Policy>(
+                input, first + j, parameters, cache, batch, j
+            );
+        }
+    }
+
+    calculateUnsealed(count, parameters, cache, batch);
+    calculateSurfaces<Policy::strict>(input, first, count, parameters, batch);
+}
+
+bool CalculationKernel::isCalculated(int flags)
+{
+    return !(flags & (NUTZUNG_IS_ZERO | USAGE_UNDEFINED));
+}
+
+// Copy the results of record first + j from the batch
+void CalculationKernel::getRecord(
+    const abimoColumns& input, int first, int j, const KernelBatch& batch,
+    abimoOutputRecord& record
+)
+{
+    // write the calculated variables into respective fields
+    record.CODE = input.CODE.at(first + j);
+    record.R = batch.R[j];
+    record.ROW = batch.ROW[j];
+    record.RI = batch.RI[j];
+    record.RVOL = batch.RVOL[j];
+    record.ROWVOL = batch.ROWVOL[j];
+    record.RIVOL = batch.RIVOL[j];
+    record.FLAECHE = batch.FLAECHE[j];
+// cls_5c:
+    record.VERDUNSTUN = batch.VERDUNSTUN[j];
+}
+
+// =============================================================================
+// Collects the input values of record i that its results depend on (see
+// RecordKey). Records with equal keys have exactly the same flags and area
+// independent results (see getResult()).
+// =============================================================================
+RecordKey CalculationKernel::getKey(
+    const abimoColumns& input, int i, const KernelParameters& parameters
+)
+{
+    RecordKey key;
+    int k = 0;
+
+    float fb = input.FLGES.at(i);
+    float fs = input.STR_FLGES.at(i);
+    bool areaDefaulted = getArea(fb, fs);
+    float shares[2];
+
+    if (parameters.strict) {
+        getShares<true>(fb, fs, shares[0], shares[1]);
+    }
+    else {
+        getShares<false>(fb, fs, shares[0], shares[1]);
+    }
+
+    const float values[] = {
+        input.FLUR.at(i),
+        input.PROBAU_fraction.at(i),
+        input.PROVGU_fraction.at(i),
+        input.VGSTRASSE_fraction.at(i),
+        input.KAN_BEB_fraction.at(i),
+        input.KAN_VGU_fraction.at(i),
+        input.KAN_STR_fraction.at(i),
+        input.BELAG1_fraction.at(i),
+        input.BELAG2_fraction.at(i),
+        input.BELAG3_fraction.at(i),
+        input.BELAG4_fraction.at(i),
+        input.STR_BELAG1_fraction.at(i),
+        input.STR_BELAG2_fraction.at(i),
+        input.STR_BELAG3_fraction.at(i),
+        input.STR_BELAG4_fraction.at(i),
+        shares[0],
+        shares[1]
+    };
+
+    key.values[k++] = (quint32) input.NUTZUNG.at(i);
+    key.values[k++] = (quint32) input.REGENJA.at(i);
+    key.values[k++] = (quint32) input.REGENSO.at(i);
+    key.values[k++] = (quint32) input.TYP.at(i);
+    key.values[k++] = (quint32) input.FELD_30.at(i);
+    key.values[k++] = (quint32) input.FELD_150.at(i);
+    key.values[k++] = (quint32) input.BEZIRK.at(i);
+    key.values[k++] = areaDefaulted ? 1 : 0;
+
+    static_assert(
+        8 + Helpers::length(values) == RecordKey::SIZE,
+        "RecordKey::SIZE must match the number of values"
+    );
+
+    memcpy(key.values + k, values, sizeof(values));
+
+    return key;
+}
+
+// Get the area independent results of record j from the batch
+RecordResult CalculationKernel::getResult(const KernelBatch& batch, int j)
+{
+    RecordResult result;
+
+    result.flags = batch.flags[j];
+    result.R = batch.R[j];
+    result.ROW = batch.ROW[j];
+    result.RI = batch.RI[j];
+    result.VERDUNSTUN = batch.VERDUNSTUN[j];
+
+    return result;
+}
+
+// Same as getRecord() for record i that has the same key as a record with the
+// given results: only the area and the volumes are calculated
+void CalculationKernel::getRecord(
+    const abimoColumns& input, int i, const RecordResult& result,
+    const KernelParameters& parameters, abimoOutputRecord& record
+)
+{
+    float fb = input.FLGES.at(i);
+    float fs = input.STR_FLGES.at(i);
+
+    getArea(fb, fs);
+
+    record.CODE = input.CODE.at(i);
+    record.R = result.R;
+    record.ROW = result.ROW;
+    record.RI = result.RI;
+    record.FLAECHE = fb + fs;
+
+    if (parameters.strict) {
+        getVolumes<true>(result.ROW, result.RI, record.FLAECHE, record.ROWVOL, record.RIVOL);
+    }
+    else {
+        getVolumes<false>(result.ROW, result.RI, record.FLAECHE, record.ROWVOL, record.RIVOL);
+    }
+
+    record.RVOL = record.ROWVOL + record.RIVOL;
+    record.VERDUNSTUN = result.VERDUNSTUN;
+}
+
+// =============================================================================
+// if sum of total building development area and roads area is inconsiderably
+// small it is assumed, that the area is unknown and 100 % building development
+// area will be given by default. Returns true in this case.
+// =============================================================================
+bool CalculationKernel::getArea(float& fb, float fs)
+{
+    if (fb + fs < 0.0001)
+    {
+        fb = 100.0F;
+        return true;
+    }
+
+    return false;
+}
+
+// Verhaeltnis Bebauungsflaeche / Strassenflaeche zu Gesamtflaeche
+// ratio of building development area / road area to total area
+template <bool strict>
+inline void CalculationKernel::getShares(
+    float fb, float fs, float& fbant, float& fsant
+)
+{
+    if (strict) {
+        fbant = fb / (fb + fs);
+        fsant = fs / (fb + fs);
+    }
+    else {
+        float total = 1.0F / (fb + fs);
+        fbant = fb * total;
+        fsant = fs * total;
+    }
+}
+
+// calculate volumes 'rowvol' and 'rivol' from runoff and infiltration rate
+template <bool strict>
+inline void CalculationKernel::getVolumes(
+    float rowSum, float riSum, float flaeche, float& rowvol, float& rivol
+)
+{
+    if (strict) {
+        rowvol = rowSum * 3.171F * flaeche / 100000.0F; // qcm/s
+        rivol = riSum * 3.171F * flaeche / 100000.0F;   // qcm/s
+    }
+    else {
+        float factor = 3.171F * flaeche / 100000.0F;
+        rowvol = rowSum * factor;
+        rivol = riSum * factor;
+    }
+}
+
+// =============================================================================
+// Same as the loop over prepare<Usage::unknown>() in calculateBatchWith(), but
+// the records are grouped by their usage first and each group is prepared with
+// the version of prepare() for its usage, which has no branches on the usage.
+// The records keep their lanes, so the results are in the original order.
+// =============================================================================
+template <class Policy>
+void CalculationKernel::preparePartitioned(
+    const abimoColumns& input, int first, int count,
+    const KernelParameters& parameters, ClimateCache& cache, KernelBatch& batch
+)
+{
+    // Specialised usages, all others (unknown: NUTZUNG = 0 or usage not
+    // defined) go through prepare<Usage::unknown>()
+    const Usage usages[] = {
+        Usage::waterbody_G, Usage::forested_W, Usage::agricultural_L,
+        Usage::horticultural_K, Usage::vegetationless_D
+    };
+
+    const int groupCount = Helpers::length(usages) + 1;
+
+    // Lanes of the records of each group
+    int lanes[groupCount][KERNEL_BATCH_SIZE];
+    int counts[groupCount] = {0};
+
+    for (int j = 0; j < count; j++) {
+
+        Usage usage = getUsage(input, first + j, parameters);
+        int group = groupCount - 1;
+
+        for (int g = 0; g < groupCount - 1; g++) {
+            if (usages[g] == usage) {
+                group = g;
+            }
+        }
+
+        lanes[group][counts[group]++] = j;
+    }
+
+    prepareLanes<Usage::waterbody_G, Policy>(input, first, lanes[0], counts[0], parameters, cache, batch);
+    prepareLanes<Usage::forested_W, Policy>(input, first, lanes[1], counts[1], parameters, cache, batch);
+    prepareLanes<Usage::agricultural_L, Policy>(input, first, lanes[2], counts[2], parameters, cache, batch);
+    prepareLanes<Usage::horticultural_K, Policy>(input, first, lanes[3], counts[3], parameters, cache, batch);
+    prepareLanes<Usage::vegetationless_D, Policy>(input, first, lanes[4], counts[4], parameters, cache, batch);
+    prepareLanes<Usage::unknown, Policy>(input, first, lanes[5], counts[5], parameters, cache, batch);
+}
+
+// Prepare the records in the given lanes, all of the given usage
+template <Usage usage, class Policy>
+void CalculationKernel::prepareLanes(
+    const abimoColumns& input, int first, const int* lanes, int n,
+    const KernelParameters& parameters, ClimateCache& cache, KernelBatch& batch
+)
+{
+    for (int k = 0; k < n; k++) {
+        int j = lanes[k];
+        batch.flags[j] = prepare<usage, Policy>(input, first + j, parameters, cache, batch, j);
+    }
+}
+
+// Usage of record i as given by its (usage, yield, irrigation)-tuple,
+// Usage::unknown if NUTZUNG is 0 or there is no tuple for it
+Usage CalculationKernel::getUsage(
+    const abimoColumns& input, int i, const KernelParameters& parameters
+)
+{
+    if (input.NUTZUNG.at(i) == 0) {
+        return Usage::unknown;
+    }
+
+    const UsageEntry& entry = parameters.config.getUsageEntry(
+        input.NUTZUNG.at(i), input.TYP.at(i)
+    );
+
+    if (entry.tupleIndex < 0) {
+        return Usage::unknown;
+    }
+
+    return parameters.config.getUsageTuple(entry.tupleIndex).usage;
+}
+
+// Does a record with usage nut have the expected usage? For any usage but
+// Usage::unknown, the record is known to have this usage at compile time.
+template <Usage usage>
+inline bool CalculationKernel::hasUsage(Usage nut, Usage expected)
+{
+    return (usage == Usage::unknown) ? nut == expected : usage == expected;
+}
+
+// =============================================================================
+// Determines usage and climate of record i and puts the runoffs of the roof
+// surfaces, of the four pavement classes and of the unsealed surfaces into
+// lane j of the batch. Returns the flags of the record. Unless usage is
+// Usage::unknown, the record must have the given usage (see getUsage()).
+// =============================================================================
+template <Usage usage, class Policy>
+int CalculationKernel::prepare(
+    const abimoColumns& input, int i, const KernelParameters& parameters,
+    ClimateCache& cache, KernelBatch& batch, int j
+)
+{
+    // Intermediate values of the record (usage, soil, climate, ...)
+    PDR ptrDA;
+
+    // potentielle Aufstiegshoehe
+    float TAS = 0;
+
+    // index of the (usage, yield, irrigation)-tuple of the record
+    int tupleIndex = -1;
+
+    // Abfluesse nach Bagrov fuer Dachflaechen und Belagsklassen 1 bis 4
+    SealedRunoffs sealed;
+
+    // Versiegelungsgrad Dachflaechen / sonst. versiegelte Flaechen
+    // vegree of sealing of roof surfaces / other sealed surfaces
+    float vgd, vgb;
+
+    // Gesamtflaeche Bebauung / Strasse
+    // total area of building development / road
+    float fb, fs;
+
+    int flags = 0;
+
+    // Records that are not calculated still go through the batch: give them
+    // harmless values
+    batch.RDV[j] = 0.0F;
+    for (int k = 0; k < 4; k++) {
+        batch.RV[k][j] = 0.0F;
+    }
+    batch.RUV[j] = 0.0F;
+    batch.bagrovPending[j] = false;
+    batch.unsealed[j] = 0.0F;
+    batch.FLGES[j] = 100.0F;
+
+    // NUTZUNG = integer representing the type of area usage for each block partial area
+    if (input.NUTZUNG.at(i) == 0) {
+
+        /* cls_2: Hier koennten falls gewuenscht die Flaechen dokumentiert werden,
+           deren NUTZUNG=NULL (siehe auch cls_3)
+        */
+        return NUTZUNG_IS_ZERO;
+    }
+
+    // precipitation for entire year and for only summer season
+    ptrDA.P1 = input.REGENJA.at(i); /* Jetzt regenja,-so OK */
+    ptrDA.P1S = input.REGENSO.at(i);
+
+    // depth to groundwater table 'FLUR'
+    ptrDA.FLW = input.FLUR.at(i);
+
+    flags |= setUsage<usage, Policy>(
+        ptrDA,
+        TAS,
+        tupleIndex,
+        input.NUTZUNG.at(i),
+        input.TYP.at(i),      // structure type
+        input.FELD_30.at(i),  // field capacity [%] for 0- 30cm below ground level
+        input.FELD_150.at(i), // field capacity [%] for 0-150cm below ground level
+        parameters
+    );
+
+    if (flags & USAGE_UNDEFINED) {
+        return flags;
+    }
+
+    /* cls_6a: an dieser Stelle muss garantiert werden, dass f30 und f150
+       als Parameter von getNUTZ einen definierten Wert erhalten und zwar 0.
+
+       FIXED: alle Werte sind definiert... wenn keine 0, sondern nichts bzw. Leerzeichen
+       angegeben wurden, wird nun eine 0 eingesetzt
+       aber eigentlich war das auch schon so ... ???
+    */
+
+    // Bagrov-calculation for sealed surfaces
+    flags |= setClimate<usage, Policy>(
+        ptrDA, TAS, tupleIndex, input.BEZIRK.at(i), parameters, cache, sealed,
+        batch, j
+    );
+
+    batch.RDV[j] = sealed.RDV;
+    for (int k = 0; k < 4; k++) {
+        batch.RV[k][j] = sealed.RV[k];
+    }
+
+    // share of roof area [%] 'PROBAU'
+    vgd = input.PROBAU_fraction.at(i);
+
+    // share of other sealed areas (e.g. Hofflaechen) and calculate total sealed area
+    vgb = input.PROVGU_fraction.at(i);
+    ptrDA.VER = INT_ROUND(vgd * 100 + vgb * 100);
+
+    // share of unsealed areas
+    batch.unsealed[j] = (100.0F - (float) ptrDA.VER) / 100.0F;
+
+    fb = input.FLGES.at(i);
+    fs = input.STR_FLGES.at(i);
+
+    if (getArea(fb, fs)) {
+        flags |= AREA_DEFAULTED;
+    }
+
+    batch.FLGES[j] = fb;
+
+    return flags;
+}
+
+// =============================================================================
+// Calculates runoff, infiltration and evaporation of the records first to
+// first + count - 1 from the runoffs in the batch. There are no branches and
+// each value is an array over the records, so that the compiler vectorises the
+// loops (SSE2 on every x86-64, AVX2 with CONFIG+=avx2, see common.pri).
+//
+// strict = true: the operations are the same and in the same order as in the
+// scalar code that this replaces, so the results are exactly the same.
+//
+// strict = false: common factors are calculated only once per record. As
+// floating point arithmetic is not associative, the results may differ from
+// the strict ones by a few units in the last place of a float (a relative
+// difference of at most about 1e-6 of the largest term). After rounding to the
+// decimals of the output file single values may differ in the last decimal.
+// =============================================================================
+template <bool strict>
+void CalculationKernel::calculateSurfaces(
+    const abimoColumns& input, int first, int count,
+    const KernelParameters& parameters, KernelBatch& batch
+)
+{
+    // share of each pavement class for surfaces except roads of block area
+    const float* bl[4] = {
+        input.BELAG1_fraction.constData() + first,
+        input.BELAG2_fraction.constData() + first,
+        input.BELAG3_fraction.constData() + first,
+        input.BELAG4_fraction.constData() + first
+    };
+
+    // share of each pavement class for roads of block area
+    const float* bls[4] = {
+        input.STR_BELAG1_fraction.constData() + first,
+        input.STR_BELAG2_fraction.constData() + first,
+        input.STR_BELAG3_fraction.constData() + first,
+        input.STR_BELAG4_fraction.constData() + first
+    };
+
+    // Infiltrationsfaktoren der Belagsklassen
+    const float infbel[4] = {
+        parameters.infbel1, parameters.infbel2, parameters.infbel3,
+        parameters.infbel4
+    };
+
+    // share of roof area, of other sealed areas and of sealed road area
+    const float* vgd = input.PROBAU_fraction.constData() + first;
+    const float* vgb = input.PROVGU_fraction.constData() + first;
+    const float* vgs = input.VGSTRASSE_fraction.constData() + first;
+
+    // degree of canalization for roof / other sealed areas / sealed roads
+    const float* kd = input.KAN_BEB_fraction.constData() + first;
+    const float* kb = input.KAN_VGU_fraction.constData() + first;
+    const float* ks = input.KAN_STR_fraction.constData() + first;
+
+    const float* fs = input.STR_FLGES.constData() + first;
+    const int* regenja = input.REGENJA.constData() + first;
+    const float* fb = batch.FLGES;
+
+    // Verhaeltnis Bebauungsflaeche / Strassenflaeche zu Gesamtflaeche
+    // ratio of building development area / road area to total area
+    float fbant[KERNEL_BATCH_SIZE];
+    float fsant[KERNEL_BATCH_SIZE];
+
+    // Factors common to all pavement classes (strict = false only): sealed
+    // share and canalized sealed share of buildings and roads
+    float sealedB[KERNEL_BATCH_SIZE], sealedS[KERNEL_BATCH_SIZE];
+    float canalB[KERNEL_BATCH_SIZE], canalS[KERNEL_BATCH_SIZE];
+
+    // Abfluss- / Infiltrationsvariablen der versiegelten Flaechen
+    // runoff / infiltration variables of sealed surfaces
+    float row[4][KERNEL_BATCH_SIZE];
+    float ri[4][KERNEL_BATCH_SIZE];
+
+    for (int j = 0; j < count; j++) {
+
+        getShares<strict>(fb[j], fs[j], fbant[j], fsant[j]);
+
+        if (!strict) {
+            sealedB[j] = vgb[j] * fbant[j];
+            sealedS[j] = vgs[j] * fsant[j];
+            canalB[j] = kb[j] * sealedB[j];
+            canalS[j] = ks[j] * sealedS[j];
+        }
+    }
+
+    /*  Legende der Abflussberechnung der 4 Belagsklassen bzw. Dachklasse:
+        rowd / rowx: Abfluss Dachflaeche / Abfluss Belagsflaeche x
+        infdach / infbelx: Infiltrationsparameter Dachfl. / Belagsfl. x
+        belx: Anteil Belagsklasse x
+        blsx: Anteil Strassenbelagsklasse x
+        vgd / vgb: Anteil versiegelte Dachfl. / sonstige versiegelte Flaeche zu Gesamtblockteilflaeche
+        kd / kb / ks: Grad der Kanalisierung Dach / sonst. vers. Fl. / Strassenflaechen
+        fbant / fsant: ?
+        RDV / RxV: Gesamtabfluss versiegelte Flaeche
+    */
+    for (int k = 0; k < 4; k++) {
+
+        const float* RV = batch.RV[k];
+
+        for (int j = 0; j < count; j++) {
+            if (strict) {
+                row[k][j] = (1.0F - infbel[k]) * (
+                    bl[k][j] * kb[j] * vgb[j] * fbant[j] +
+                    bls[k][j] * ks[j] * vgs[j] * fsant[j]
+                ) * RV[j];
+                ri[k][j] = (
+                    bl[k][j] * vgb[j] * fbant[j] +
+                    bls[k][j] * vgs[j] * fsant[j]
+                ) * RV[j] - row[k][j];
+            }
+            else {
+                row[k][j] = (1.0F - infbel[k]) *
+                    (bl[k][j] * canalB[j] + bls[k][j] * canalS[j]) * RV[j];
+                ri[k][j] = (bl[k][j] * sealedB[j] + bls[k][j] * sealedS[j]) *
+                    RV[j] - row[k][j];
+            }
+        }
+    }
+
+    for (int j = 0; j < count; j++) {
+
+        // Runoff and infiltration for roof surfaces
+        float rowd = (1.0F - parameters.infdach) * vgd[j] * kd[j] * fbant[j] * batch.RDV[j];
+        float rid = (1 - kd[j]) * vgd[j] * fbant[j] * batch.RDV[j];
+
+        // consider unsealed road surfaces as pavement class 4
+        float rowuvs = 0.0F;                              /* old: 0.11F * (1-vgs) * fsant * R4V; */
+        float riuvs = (1 - vgs[j]) * fsant[j] * batch.RV[3][j]; /* old: 0.89F * (1-vgs) * fsant * R4V; */
+
+        // runoff for unsealed surfaces rowuv = 0
+        float riuv = batch.unsealed[j] * batch.RUV[j];
+
+        // calculate runoff 'row' for entire block patial area (FLGES+STR_FLGES)
+        float rowSum = (row[0][j] + row[1][j] + row[2][j] + row[3][j] + rowd + rowuvs); // mm/a
+
+        // calculate infiltration rate 'ri' for entire block partial area
+        float riSum = (ri[0][j] + ri[1][j] + ri[2][j] + ri[3][j] + rid + riuvs + riuv); // mm/a
+
+        // calculate total system losses 'r' due to runoff and infiltration for entire block partial area
+        float r = rowSum + riSum;
+
+        // calculate total area of building development area as well as roads area
+        float flaeche = fb[j] + fs[j];
+
+        getVolumes<strict>(rowSum, riSum, flaeche, batch.ROWVOL[j], batch.RIVOL[j]);
+
+        // calculate volume of system losses 'rvol'due to runoff and infiltration
+        batch.RVOL[j] = batch.ROWVOL[j] + batch.RIVOL[j];
+
+        batch.ROW[j] = rowSum;
+        batch.RI[j] = riSum;
+        batch.R[j] = r;
+        batch.FLAECHE[j] = flaeche;
+// cls_5b:
+        // calculate evaporation 'verdunst' by subtracting the sum of
+        // runoff and infiltration 'r' from precipitation of entire year
+        // 'regenja' multiplied by correction factor 'niedKorrFaktor'
+        batch.VERDUNSTUN[j] = ((float) regenja[j] * parameters.niedKorrF) - r;
+    }
+}
+
+// =============================================================================
+// Sets usage, yield and irrigation as well as the capillary rise of the
+// record. Also calculates the potential ascent height tas.
+// =============================================================================
+template <Usage usage, class Policy>
+int CalculationKernel::setUsage(
+    PDR& pdr, float& tas, int& tupleIndex, int usage, int type, int f30,
+    int f150, const KernelParameters& parameters
+)
+{
+    // mittlere pot. kapillare Aufstiegsrate d. Sommerhalbjahres
+    float kr;
+
+    int flags = 0;
+
+    /*
+     * Feldlaengen von iTAS und inFK_S, L, T, U ;
+     * extern int lenTAS, lenS, lenL, lenT, lenU;
+     */
+
+    // declaration of yield power (ERT) and irrigation (BER) for agricultural or gardening purposes
+    const UsageEntry& entry = parameters.config.getUsageEntry(usage, type);
+
+    if (entry.tupleIndex < 0) {
+        return USAGE_UNDEFINED;
+    }
+
+    if (entry.typeDefaulted) {
+        flags |= TYPE_DEFAULTED;
+    }
+
+    tupleIndex = entry.tupleIndex;
+    pdr.setUsageYieldIrrigation(parameters.config.getUsageTuple(tupleIndex));
+
+    if (!hasUsage<usage>(pdr.NUT, Usage::waterbody_G))
+    {
+        /* pot. Aufstiegshoehe TAS = FLUR - mittl. Durchwurzelungstiefe TWS */
+        tas = pdr.FLW - parameters.config.getTWS(pdr.ERT, pdr.NUT);
+
+        /* Feldkapazitaet */
+        /* cls_6b: der Fall der mit NULL belegten FELD_30 und FELD_150 Werte
+           wird hier im erten Fall behandelt - ich erwarte dann den Wert 0 */
+        pdr.nFK = PDR::estimateWaterHoldingCapacity(
+            f30, f150, hasUsage<usage>(pdr.NUT, Usage::forested_W)
+        );
+
+        /*
+         * mittlere pot. kapillare Aufstiegsrate kr (mm/d) des Sommerhalbjahres ;
+         * switch (bod) { case S: case U: case L: case T: case LO: case HN: } wird
+         * eingefuegt, wenn die Bodenart in das Zahlenmaterial aufgenommen wird vorlaeufig
+         * wird Sande angenommen ;
+         * Sande
+         */
+        static_assert(
+            Helpers::length(iTAS) == lenTAS && Helpers::isSorted(iTAS) &&
+            Helpers::length(inFK_S) == lenS && Helpers::isSorted(inFK_S) &&
+            Helpers::length(ijkr_S) == lenTAS * lenS,
+            "iTAS and inFK_S must be in ascending order, ijkr_S needs a value for each pair"
+        );
+
+        kr = (tas <= 0.0) ?
+            7.0F :
+            ijkr_S[
+                Helpers::index(tas, iTAS) +
+                Helpers::index(pdr.nFK, inFK_S) * lenTAS
+            ];
+
+        /* mittlere pot. kapillare Aufstiegsrate kr (mm/d) des Sommerhalbjahres */
+        pdr.KR = (int) (PDR::estimateDaysOfGrowth(pdr.NUT, pdr.ERT) * kr);
+    }
+
+    if (Policy::BERtoZero && pdr.BER != 0) {
+        flags |= BER_SET_TO_ZERO;
+        pdr.BER = 0;
+    }
+
+    return flags;
+}
+
+// =============================================================================
+// Calculates the runoffs of the sealed surfaces (sealed, from the cache if
+// possible) and of the unsealed surfaces (ruv) from the climate of the district
+// =============================================================================
+template <Usage usage, class Policy>
+int CalculationKernel::setClimate(
+    PDR& pdr, float tas, int tupleIndex, int bez,
+    const KernelParameters& parameters, ClimateCache& cache,
+    SealedRunoffs& sealed, KernelBatch& batch, int j
+)
+{
+    // Effektivitaetsparameter
+    float bag;
+
+    // ep = potential evaporation
+    float ep;
+
+    // prepcipitation at ground level
+    float p;
+
+    // ratio of precipitation to potential evaporation
+    float x;
+
+    bool defaulted;
+    int flags = 0;
+
+    // parameter for the city districts
+    if (hasUsage<usage>(pdr.NUT, Usage::waterbody_G))
+    {
+        pdr.ETP = parameters.districtEG.get(bez, defaulted);
+        flags |= defaulted ? EG_DEFAULTED : 0;
+    }
+    else
+    {
+        pdr.ETP = parameters.districtETP.get(bez, defaulted);
+        flags |= defaulted ? ETP_DEFAULTED : 0;
+
+        pdr.ETPS = parameters.districtETPS.get(bez, defaulted);
+        flags |= defaulted ? ETPS_DEFAULTED : 0;
+    }
+
+    // declaration potential evaporation ep and precipitation p
+    ep = (float) pdr.ETP; /* Korrektur mit 1.1 gestrichen */
+    p = (float) pdr.P1 * parameters.niedKorrF; /* ptrDA.KF */
+
+    /*
+     * Berechnung der Abfluesse RDV und R1V bis R4V fuer versiegelte
+     * Teilflaechen und unterschiedliche Bagrovwerte ND und N1 bis N4
+     */
+
+    // Solver of this thread for the constant values of bag of the sealed
+    // surfaces, keeping their coefficients
+    Bagrov& bagrov = cache.getSealedBagrov();
+
+    // p and ep only depend on REGENJA and ETP: calculate each pair only once
+    if (!cache.lookup((int) pdr.P1, pdr.ETP, sealed)) {
+
+        // ratio precipitation to potential evaporation
+        x = p / ep;
+
+        /* Berechnung des Abflusses RxV fuer versiegelte Teilflaechen mittels
+           Umrechnung potentieller Verdunstungen ep zu realen über Umrechnungsfaktor y und
+           subtrahiert von Niederschlag p */
+
+        sealed.RDV = p - bagrov.nbagro(parameters.bagdach, x) * ep;
+        sealed.RV[0] = p - bagrov.nbagro(parameters.bagbel1, x) * ep;
+        sealed.RV[1] = p - bagrov.nbagro(parameters.bagbel2, x) * ep;
+        sealed.RV[2] = p - bagrov.nbagro(parameters.bagbel3, x) * ep;
+        sealed.RV[3] = p - bagrov.nbagro(parameters.bagbel4, x) * ep;
+
+        cache.insert((int) pdr.P1, pdr.ETP, sealed);
+    }
+
+    // Calculate runoff RUV for unsealed partial surfaces
+    if (hasUsage<usage>(pdr.NUT, Usage::waterbody_G))
+    {
+        batch.RUV[j] = p - ep;
+    }
+    else
+    {
+        // Determine effectiveness parameter bag for unsealed surfaces (taken
+        // from the table, calculated if it is not in there)
+        // Without summer values ETPS is 0 for all districts
+        bool notSummer = Policy::summer ?
+            pdr.P1S == 0 && pdr.ETPS == 0 :
+            pdr.P1S == 0;
+
+        if (!parameters.effectiveness.lookup(
+            tupleIndex, (int) (pdr.nFK + 0.5), notSummer, bag
+        )) {
+            bag = EffectivenessUnsealed::getNUV(pdr); /* Modul Raster abgespeckt */
+        }
+
+        if (Policy::summer && pdr.P1S > 0 && pdr.ETPS > 0) {
+            bag *= getSummerModificationFactor(
+                (float) (pdr.P1S + pdr.BER + pdr.KR) / pdr.ETPS
+            );
+        }
+
+        // Calculate the x-factor of bagrov relation: x = (P + KR + BER)/ETP.
+        // The y-factor y = fbag(n, x) is calculated for all records of the
+        // batch at once in calculateUnsealed()
+        batch.bagrovPending[j] = true;
+        batch.BAG[j] = bag;
+        batch.X[j] = (p + pdr.KR + pdr.BER) / ep;
+        batch.P[j] = p;
+        batch.EP[j] = ep;
+        batch.TAS[j] = tas;
+        batch.FLW[j] = pdr.FLW;
+    }
+
+    return flags;
+}
+
+// =============================================================================
+// Calculates the runoff RUV of the unsealed surfaces of the records whose
+// Bagrov relation is still to be solved, solving it for all of them at once
+// =============================================================================
+void CalculationKernel::calculateUnsealed(
+    int count, const KernelParameters& parameters, ClimateCache& cache,
+    KernelBatch& batch
+)
+{
+    // real evapotranspiration
+    float etr;
+
+    // Parameters and results of the Bagrov relation, lane of each record
+    float bags[KERNEL_BATCH_SIZE];
+    float xs[KERNEL_BATCH_SIZE];
+    float ys[KERNEL_BATCH_SIZE];
+    int lanes[KERNEL_BATCH_SIZE];
+    int n = 0;
+
+    for (int j = 0; j < count; j++) {
+        if (batch.bagrovPending[j]) {
+            bags[n] = batch.BAG[j];
+            xs[n] = batch.X[j];
+            lanes[n++] = j;
+        }
+    }
+
+    switch (parameters.bagrovSolver) {
+
+        case BagrovSolver::Table:
+            for (int k = 0; k < n; k++) {
+                ys[k] = parameters.bagrovTable->nbagro(bags[k], xs[k]);
+            }
+            break;
+
+        case BagrovSolver::Exact:
+            for (int k = 0; k < n; k++) {
+                ys[k] = cache.getUnsealedBagrov().nbagroExact(bags[k], xs[k]);
+            }
+            break;
+
+        default:
+            cache.getUnsealedBagrov().nbagro(bags, xs, ys, n);
+    }
+
+    for (int k = 0; k < n; k++) {
+
+        int j = lanes[k];
+        float ep = batch.EP[j];
+
+        // Get the real evapotransporation using estimated y-factor
+        etr = ys[k] * ep;
+
+        if (batch.TAS[j] < 0) {
+            etr += (ep - ys[k] * ep) * (float) exp(batch.FLW[j] / batch.TAS[j]);
+        }
+
+        batch.RUV[j] = batch.P[j] - etr;
+    }
+}
+
+// =============================================================================
+// Get factor to be applied for "summer"
+// =============================================================================
+float CalculationKernel::getSummerModificationFactor(float wa)
+{
+    static constexpr float watab[] =
+    {
+        0.45F, 0.50F, 0.55F, 0.60F, 0.65F, 0.70F, 0.75F, // 0 ..  6
+        0.80F, 0.85F, 0.90F, 0.95F, 1.00F, 1.05F, 1.10F  // 7 .. 13
+    };
+
+    static constexpr float Ftab[] =
+    {
+        0.65F, 0.75F, 0.82F, 0.90F, 1.00F, 1.06F, 1.15F, // 0 ..  6
+        1.22F, 1.30F, 1.38F, 1.47F, 1.55F, 1.63F, 1.70F  // 7 .. 13
+    };
+
+    static_assert(
+        Helpers::length(watab) == Helpers::length(Ftab) &&
+        Helpers::isSorted(watab),
+        "watab and Ftab must have the same length, watab in ascending order"
+    );
+
+    return Helpers::interpolate(wa, watab, Ftab);
+}
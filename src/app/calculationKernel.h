@@ -0,0 +1,325 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#ifndef CALCULATIONKERNEL_H
+#define CALCULATIONKERNEL_H
+
+#include <QHash>
+
+#include "bagrov.h"
+#include "bagrovTable.h"
+#include "config.h"
+#include "dbaseReader.h"
+#include "dbaseWriter.h"
+#include "effectivenessunsealed.h"
+#include "initvalues.h"
+#include "pdr.h"
+
+// Number of records that CalculationKernel::calculateBatch() calculates at once
+#define KERNEL_BATCH_SIZE 16
+
+// Snapshot of all parameters that the calculation of a record depends on.
+// It is created once per run and then only read, so that it can be shared by
+// any number of threads.
+struct KernelParameters {
+
+    KernelParameters();
+    KernelParameters(InitValues& initValues);
+
+    // Infiltrationsfaktoren
+    float infdach, infbel1, infbel2, infbel3, infbel4;
+
+    // Bagrovwerte
+    float bagdach, bagbel1, bagbel2, bagbel3, bagbel4;
+
+    // Niederschlags-Korrekturfaktor
+    float niedKorrF;
+
+    // BER to Zero hack
+    bool BERtoZero;
+
+    // Summer values may be given: ETPS is not 0 for all districts
+    bool summer;
+
+    // Calculate the surfaces exactly as the scalar code did (see
+    // CalculationKernel::calculateSurfaces())
+    bool strict;
+
+    // Prepare the records of a batch grouped by usage, each group with a
+    // version of the kernel for its usage (see
+    // CalculationKernel::preparePartitioned()). The results are the same.
+    bool partitioned;
+
+    // Solver of the Bagrov relation of the unsealed surfaces and its table
+    // (only set for BagrovSolver::Table)
+    BagrovSolver bagrovSolver;
+    const BagrovTable* bagrovTable;
+
+    // ETP, ETPS and EG per district (BEZIRK)
+    DistrictValues districtETP;
+    DistrictValues districtETPS;
+    DistrictValues districtEG;
+
+    // Assignment of (usage, yield, irrigation) to usage and type
+    Config config;
+
+    // Effectiveness parameter of the unsealed surfaces for each tuple of
+    // config (must be built again when config or BERtoZero change)
+    EffectivenessTable effectiveness;
+};
+
+// Settings that are the same for a whole calculation (see KernelParameters),
+// given to the kernel as constants, so that the compiler removes the code
+// that is not needed for them (see CalculationKernel::calculateBatch())
+template <bool strictValue, bool BERtoZeroValue, bool summerValue>
+struct KernelPolicy {
+    static const bool strict = strictValue;
+    static const bool BERtoZero = BERtoZeroValue;
+    static const bool summer = summerValue;
+};
+
+// Values of up to KERNEL_BATCH_SIZE records, one array per value (structure of
+// arrays), so that the same arithmetic can be done for several records at once
+struct KernelBatch {
+
+    // Abfluesse nach Bagrov fuer Dachflaechen und Belagsklassen 1 bis 4
+    float RDV[KERNEL_BATCH_SIZE];
+    float RV[4][KERNEL_BATCH_SIZE];
+
+    // Abfluss und Anteil der unversiegelten Flaechen
+    float RUV[KERNEL_BATCH_SIZE];
+    float unsealed[KERNEL_BATCH_SIZE];
+
+    // Bagrov relation of the unsealed surfaces still to be solved for RUV:
+    // effectiveness BAG, x = (P + KR + BER)/ETP, precipitation P, potential
+    // evaporation EP, TAS and FLW (only used where bagrovPending is set)
+    bool bagrovPending[KERNEL_BATCH_SIZE];
+    float BAG[KERNEL_BATCH_SIZE];
+    float X[KERNEL_BATCH_SIZE];
+    float P[KERNEL_BATCH_SIZE];
+    float EP[KERNEL_BATCH_SIZE];
+    float TAS[KERNEL_BATCH_SIZE];
+    float FLW[KERNEL_BATCH_SIZE];
+
+    // Bebauungsflaeche (100 if there is no area given at all)
+    float FLGES[KERNEL_BATCH_SIZE];
+
+    // Results
+    float R[KERNEL_BATCH_SIZE];
+    float ROW[KERNEL_BATCH_SIZE];
+    float RI[KERNEL_BATCH_SIZE];
+    float RVOL[KERNEL_BATCH_SIZE];
+    float ROWVOL[KERNEL_BATCH_SIZE];
+    float RIVOL[KERNEL_BATCH_SIZE];
+    float FLAECHE[KERNEL_BATCH_SIZE];
+    float VERDUNSTUN[KERNEL_BATCH_SIZE];
+    int flags[KERNEL_BATCH_SIZE];
+};
+
+// Runoffs of the sealed surfaces (roof surfaces, pavement classes 1 to 4)
+struct SealedRunoffs {
+    float RDV;
+    float RV[4];
+};
+
+// The runoffs of the sealed surfaces of a record only depend on its
+// precipitation REGENJA and its potential evaporation ETP, of which there are
+// only few different values. This cache keeps the runoffs per (REGENJA, ETP)
+// during one calculation (the parameters must not change). It also holds the
+// Bagrov solvers with their coefficients: one for the five constant values of
+// bag of the sealed surfaces, which therefore stay in its coefficient slots
+// for the whole calculation, and one for the values of bag of the unsealed
+// surfaces, which change from record to record. It is not thread safe: each
+// thread needs a cache of its own.
+class ClimateCache
+{
+public:
+    ClimateCache();
+    bool lookup(int precipitation, int etp, SealedRunoffs& runoffs) const;
+    void insert(int precipitation, int etp, const SealedRunoffs& runoffs);
+    Bagrov& getSealedBagrov();
+    Bagrov& getUnsealedBagrov();
+
+    // Maximum number of cached (REGENJA, ETP) pairs
+    const static int MAX_CLIMATES = 65536;
+
+private:
+    QHash<quint64, SealedRunoffs> entries;
+    Bagrov sealedBagrov;
+    Bagrov unsealedBagrov;
+    static quint64 key(int precipitation, int etp);
+};
+
+// Input values of a record that its results depend on: all fields that the
+// kernel reads except CODE, FLGES and STR_FLGES, of which only the shares of
+// the two areas in the total area count (as bits, so that equal keys give
+// exactly equal results)
+struct RecordKey {
+    const static int SIZE = 25;
+    quint32 values[SIZE];
+
+    bool operator==(const RecordKey& other) const;
+};
+
+uint qHash(const RecordKey& key, uint seed = 0);
+
+// Results of a record that do not depend on its area
+struct RecordResult {
+    int flags;
+    float R;
+    float ROW;
+    float RI;
+    float VERDUNSTUN;
+};
+
+// Many block partial areas have the same input values except for their code
+// and area. This cache keeps the area independent results per RecordKey
+// during one calculation (the parameters must not change), so that each
+// distinct record is calculated only once. It is not thread safe: each thread
+// needs a cache of its own.
+class RecordCache
+{
+public:
+    RecordCache();
+    bool lookup(const RecordKey& key, RecordResult& result) const;
+    void insert(const RecordKey& key, const RecordResult& result);
+
+    // Maximum number of cached records
+    const static int MAX_RECORDS = 65536;
+
+private:
+    QHash<RecordKey, RecordResult> entries;
+};
+
+// Calculation of the results of one record (block partial area) or of a batch
+// of records. All intermediate values are local, all parameters come from the
+// (read only) KernelParameters. Instead of writing messages, the kernel returns
+// flags that tell the caller what to report.
+class CalculationKernel
+{
+public:
+    // Diagnostics of the calculation of one record
+    enum Flag {
+        // NUTZUNG is 0, the record is not calculated
+        NUTZUNG_IS_ZERO = 0x01,
+        // no (usage, yield, irrigation) for NUTZUNG, the record is not calculated
+        USAGE_UNDEFINED = 0x02,
+        // the usage type TYP was replaced with a default type
+        TYPE_DEFAULTED = 0x04,
+        // BER was set to 0 (BERtoZero)
+        BER_SET_TO_ZERO = 0x08,
+        // no EG, ETP or ETPS given for the district, default value used
+        EG_DEFAULTED = 0x10,
+        ETP_DEFAULTED = 0x20,
+        ETPS_DEFAULTED = 0x40,
+        // FLGES + STR_FLGES is (about) 0, 100 used for FLGES
+        AREA_DEFAULTED = 0x80
+    };
+
+    CalculationKernel();
+
+    static int calculate(
+        const abimoColumns& input, int i, const KernelParameters& parameters,
+        abimoOutputRecord& record
+    );
+
+    static void calculateBatch(
+        const abimoColumns& input, int first, int count,
+        const KernelParameters& parameters, ClimateCache& cache,
+        KernelBatch& batch
+    );
+
+    static bool isCalculated(int flags);
+
+    static void getRecord(
+        const abimoColumns& input, int first, int j, const KernelBatch& batch,
+        abimoOutputRecord& record
+    );
+
+    static RecordKey getKey(
+        const abimoColumns& input, int i, const KernelParameters& parameters
+    );
+    static RecordResult getResult(const KernelBatch& batch, int j);
+    static void getRecord(
+        const abimoColumns& input, int i, const RecordResult& result,
+        const KernelParameters& parameters, abimoOutputRecord& record
+    );
+
+private:
+    const static float iTAS[];
+    const static float inFK_S[];
+    const static float ijkr_S[];
+    const static int lenTAS = 15;
+    const static int lenS = 7;
+
+    static bool getArea(float& fb, float fs);
+
+    template <bool strict>
+    static void getShares(float fb, float fs, float& fbant, float& fsant);
+
+    template <bool strict>
+    static void getVolumes(
+        float rowSum, float riSum, float flaeche, float& rowvol, float& rivol
+    );
+
+    template <class Policy>
+    static void calculateBatchWith(
+        const abimoColumns& input, int first, int count,
+        const KernelParameters& parameters, ClimateCache& cache,
+        KernelBatch& batch
+    );
+
+    template <class Policy>
+    static void preparePartitioned(
+        const abimoColumns& input, int first, int count,
+        const KernelParameters& parameters, ClimateCache& cache,
+        KernelBatch& batch
+    );
+
+    template <Usage usage, class Policy>
+    static void prepareLanes(
+        const abimoColumns& input, int first, const int* lanes, int n,
+        const KernelParameters& parameters, ClimateCache& cache,
+        KernelBatch& batch
+    );
+
+    static Usage getUsage(
+        const abimoColumns& input, int i, const KernelParameters& parameters
+    );
+
+    template <Usage usage>
+    static bool hasUsage(Usage nut, Usage expected);
+
+    template <Usage usage, class Policy>
+    static int prepare(
+        const abimoColumns& input, int i, const KernelParameters& parameters,
+        ClimateCache& cache, KernelBatch& batch, int j
+    );
+
+    template <bool strict>
+    static void calculateSurfaces(
+        const abimoColumns& input, int first, int count,
+        const KernelParameters& parameters, KernelBatch& batch
+    );
+
+    template <Usage usage, class Policy>
+    static int setUsage(
+        PDR& pdr, float& tas, int& tupleIndex, int usage, int type, int f30,
+        int f150, const KernelParameters& parameters
+    );
+    template <Usage usage, class Policy>
+    static int setClimate(
+        PDR& pdr, float tas, int tupleIndex, int bez,
+        const KernelParameters& parameters, ClimateCache& cache,
+        SealedRunoffs& sealed, KernelBatch& batch, int j
+    );
+    static void calculateUnsealed(
+        int count, const KernelParameters& parameters, ClimateCache& cache,
+        KernelBatch& batch
+    );
+    static float getSummerModificationFactor(float wa);
+};
+
+#endif // CALCULATIONKERNEL_H
@@ -1,12 +1,26 @@
+#include <QFile>
 #include <QHash>
+#include <QMap>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
 
 #include "config.h"
+#include "helpers.h"
 #include "pdr.h"
 
-Config::Config()
+// Largest identifier or value in a usage table file
+#define MAX_IDENTIFIER 999
+
+const UsageEntry Config::undefinedEntry = {-1, false, 0};
+
+Config::Config():
+    minType(0),
+    typeCount(0)
 {    
     initUsageYieldIrrigationTuples();
     initUsageAndTypeToTupleHash();
+    compile();
 }
 
 void Config::initUsageYieldIrrigationTuples()
@@ -16,6 +30,8 @@ void Config::initUsageYieldIrrigationTuples()
     // NUT = 'K': gardening
     // NUT = 'L': agricultural land use
 
+    usageTuples.resize(16);
+
     usageTuples[ 0] = {Usage::vegetationless_D,  1,   0};
     usageTuples[ 1] = {Usage::waterbody_G,       0,   0};
     usageTuples[ 2] = {Usage::horticultural_K,  40,  75};
@@ -171,7 +187,7 @@ void Config::initUsageAndTypeToTupleHash()
 //==============================================================================
 //    Bestimmung der Durchwurzelungstiefe TWS
 //==============================================================================
-float Config::getTWS(int ert, Usage nutz)
+float Config::getTWS(int ert, Usage nutz) const
 {
     // Zuordnung Durchwurzelungstiefe in Abhaengigkeit der Nutzung
     switch(nutz) {
@@ -193,9 +209,192 @@ float Config::getTWS(int ert, Usage nutz)
     }
 }
 
-UsageResult Config::getUsageResult(int usage, int type, QString code)
+//==============================================================================
+// Compile usageHash into the tables of entries, so that getUsageEntry() only
+// needs to read one entry per record
+//==============================================================================
+void Config::compile()
 {
-    if (!usageHash.contains(usage)) {
+    int maxUsage = -1;
+    int maxType = 0;
+
+    minType = 0;
+
+    for (auto usage = usageHash.constBegin(); usage != usageHash.constEnd(); ++usage) {
+
+        maxUsage = qMax(maxUsage, usage.key());
+
+        for (auto type = usage->constBegin(); type != usage->constEnd(); ++type) {
+            minType = qMin(minType, type.key());
+            maxType = qMax(maxType, type.key());
+        }
+    }
+
+    typeCount = maxType - minType + 1;
+
+    usageTable.fill(undefinedEntry, (maxUsage + 1) * typeCount);
+    otherTypeEntries.fill(undefinedEntry, maxUsage + 1);
+
+    for (auto usage = usageHash.constBegin(); usage != usageHash.constEnd(); ++usage) {
+
+        for (int type = minType; type <= maxType; type++) {
+            usageTable[usage.key() * typeCount + type - minType] =
+                lookup(usage.value(), type);
+        }
+
+        otherTypeEntries[usage.key()] = lookup(usage.value(), maxType + 1);
+    }
+}
+
+//==============================================================================
+// Read the (usage, yield, irrigation)-tuples and the assignment of usage and
+// type identifiers to them from a text file, replacing the built-in ones.
+// Each line is empty, a comment starting with '#' or one of
+//   tuple,<index, from 0 in this order>,<usage: L|W|G|K|D>,<yield>,<irrigation>
+//   type,<usage identifier>,<type identifier or * for all types>,<tuple index>
+//   default,<usage identifier>,<type identifier>
+// where "default" gives the type whose tuple is used for types that are not
+// listed. That type needs a "type" line, and each usage a "default" line or a
+// "type" line for all types. Returns an error message (empty if the file was
+// read).
+//==============================================================================
+QString Config::load(QString fileName)
+{
+    QString prefix = Helpers::singleQuote(fileName) + ": ";
+    QVector<UsageTuple> tuples;
+    QHash<int,QHash<int,int>> hash;
+
+    // Line numbers of the first "type" line and of the "default" line of each
+    // usage
+    QHash<int,int> typeLines;
+    QHash<int,int> defaultLines;
+
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return prefix + "Datei kann nicht gelesen werden.";
+    }
+
+    QTextStream stream(&file);
+    int lineNumber = 0;
+
+    while (!stream.atEnd()) {
+
+        QString line = stream.readLine().trimmed();
+        lineNumber++;
+
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        QStringList fields = line.split(',');
+        QString kind = fields.at(0).trimmed();
+        bool ok = true;
+
+        // Values of the further fields, -2 for '*', the character of a usage
+        QVector<int> values;
+
+        for (int i = 1; i < fields.size() && ok; i++) {
+
+            QString field = fields.at(i).trimmed();
+
+            if (kind == "tuple" && i == 2) {
+                ok = field.size() == 1 && QString("LWGKD").contains(field);
+                values.append(ok ? field.at(0).toLatin1() : 0);
+            }
+            else if (kind == "type" && i == 2 && field == "*") {
+                values.append(-2);
+            }
+            else {
+                values.append(field.toInt(&ok));
+                ok = ok && values.last() >= 0 && values.last() <= MAX_IDENTIFIER;
+            }
+        }
+
+        if (ok && kind == "tuple" && values.size() == 4 && values.at(0) == tuples.size()) {
+            tuples.append({(Usage) values.at(1), values.at(2), values.at(3)});
+        }
+        else if (ok && kind == "type" && values.size() == 3) {
+            hash[values.at(0)][values.at(1)] = values.at(2);
+
+            if (!typeLines.contains(values.at(0))) {
+                typeLines[values.at(0)] = lineNumber;
+            }
+        }
+        else if (ok && kind == "default" && values.size() == 2) {
+            hash[values.at(0)][-1] = values.at(1);
+            defaultLines[values.at(0)] = lineNumber;
+        }
+        else {
+            return prefix + "Zeile " + QString::number(lineNumber) + " ungueltig.";
+        }
+    }
+
+    if (tuples.isEmpty()) {
+        return prefix + "Keine Tupel definiert.";
+    }
+
+    for (const QHash<int,int>& type2tuple : hash) {
+        for (auto type = type2tuple.constBegin(); type != type2tuple.constEnd(); ++type) {
+            if (type.key() != -1 && type.value() >= tuples.size()) {
+                return prefix + "Tupel " + QString::number(type.value()) + " nicht definiert.";
+            }
+        }
+    }
+
+    // Usages that getUsageEntry() could not resolve, by line (the first one is
+    // reported)
+    QMap<int,QString> errors;
+
+    for (auto usage = hash.constBegin(); usage != hash.constEnd(); ++usage) {
+
+        QString usageText = QString::number(usage.key());
+
+        if (usage->contains(-1)) {
+            int defaultType = usage->value(-1);
+
+            if (!usage->contains(defaultType)) {
+                errors[defaultLines[usage.key()]] = "Typ " +
+                    QString::number(defaultType) + " der Nutzung " + usageText +
+                    " nicht definiert.";
+            }
+        }
+        else if (!usage->contains(-2)) {
+            errors[typeLines[usage.key()]] = "Nutzung " + usageText +
+                " ohne default und ohne Typ *.";
+        }
+    }
+
+    if (!errors.isEmpty()) {
+        return prefix + "Zeile " + QString::number(errors.firstKey()) + ": " +
+            errors.first();
+    }
+
+    usageTuples = tuples;
+    usageHash = hash;
+    compile();
+
+    return QString();
+}
+
+const UsageEntry& Config::getUsageEntry(int usage, int type) const
+{
+    if (usage < 0 || usage >= otherTypeEntries.size()) {
+        return undefinedEntry;
+    }
+
+    if (type < minType || type >= minType + typeCount) {
+        return otherTypeEntries[usage];
+    }
+
+    return usageTable[usage * typeCount + type - minType];
+}
+
+UsageResult Config::getUsageResult(int usage, int type, QString code) const
+{
+    const UsageEntry& entry = getUsageEntry(usage, type);
+
+    if (entry.tupleIndex < 0) {
         return {
             -1,
             QString("\r\nDiese  Meldung sollte nie erscheinen: \r\n") +
@@ -203,29 +402,38 @@ UsageResult Config::getUsageResult(int usage, int type, QString code)
         };
     }
 
-    return lookup(usageHash[usage], type, code);
+    if (entry.typeDefaulted) {
+        QString message = "\r\nNutzungstyp nicht definiert fuer Element " +
+            code + "\r\nTyp=" + QString::number(entry.defaultType) +
+            " angenommen\r\n";
+        return {entry.tupleIndex, message};
+    }
+
+    return {entry.tupleIndex, ""};
 }
 
-UsageResult Config::lookup(QHash<int,int>hash, int type, QString code)
+UsageEntry Config::lookup(const QHash<int,int>& hash, int type)
 {
     if (hash.contains(type)) {
-        return {hash[type], ""};
+        return {(qint16) hash[type], false, 0};
     }
 
     if (hash.contains(-1)) {
         int defaultType = hash[-1];
-        QString message = "\r\nNutzungstyp nicht definiert fuer Element " +
-            code + "\r\nTyp=" + QString::number(defaultType) +
-            " angenommen\r\n";
-        return {hash[defaultType], message};
+        return {(qint16) hash.value(defaultType), true, (qint16) defaultType};
     }
 
-    return {hash[-2], ""};
+    return {(qint16) hash.value(-2), false, 0};
+}
+
+int Config::getUsageTupleCount() const
+{
+    return usageTuples.size();
 }
 
-UsageTuple Config::getUsageTuple(int tupleID)
+UsageTuple Config::getUsageTuple(int tupleID) const
 {
-    assert(tupleID >= 0);
+    assert(tupleID >= 0 && tupleID < usageTuples.size());
     return usageTuples[tupleID];
 }
 
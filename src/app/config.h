@@ -3,27 +3,50 @@
 
 #include <QHash>
 #include <QString>
+#include <QVector>
 
 #include "pdr.h" // for MainUsage, UsageResult, UsageTuple
 
+// Result of the lookup of a (usage, type) pair
+struct UsageEntry {
+    // index of the (usage, yield, irrigation)-tuple, -1: usage not defined
+    qint16 tupleIndex;
+    // type not defined for the usage, the tuple of defaultType is used
+    bool typeDefaulted;
+    qint16 defaultType;
+};
+
 class Config
 {
 public:
     Config();
-    float getTWS(int ert, Usage nutz);
-    UsageResult getUsageResult(int usage, int type, QString code);
-    UsageTuple getUsageTuple(int tupleID);
+    QString load(QString fileName);
+    float getTWS(int ert, Usage nutz) const;
+    const UsageEntry& getUsageEntry(int usage, int type) const;
+    UsageResult getUsageResult(int usage, int type, QString code) const;
+    UsageTuple getUsageTuple(int tupleID) const;
+    int getUsageTupleCount() const;
 
 private:
-    UsageTuple usageTuples[16];
+    QVector<UsageTuple> usageTuples;
 
     // assignment of usage identifiers to "type -> tuple index" hashes
     QHash<int,QHash<int,int>> usageHash;
 
+    // usageHash compiled into one entry per usage and type from minType to
+    // minType + typeCount - 1, and one entry per usage for all other types
+    QVector<UsageEntry> usageTable;
+    QVector<UsageEntry> otherTypeEntries;
+    int minType;
+    int typeCount;
+
+    const static UsageEntry undefinedEntry;
+
     void initUsageYieldIrrigationTuples();
     void initUsageAndTypeToTupleHash();
+    void compile();
 
-    UsageResult lookup(QHash<int,int>hash, int type, QString code);
+    static UsageEntry lookup(const QHash<int,int>& hash, int type);
 };
 
 #endif // CONFIG_H
@@ -4,20 +4,26 @@
  ***************************************************************************/
 
 #include <QBuffer>
-#include <QDebug>
 #include <QHash>
 #include <QIODevice>
 #include <QStringList>
 #include <QtGlobal>
 #include <QVector>
 
+#include "constants.h" // for MIN() macro
 #include "dbaseField.h"
 #include "dbaseReader.h"
+#include "fixedWidthParser.h"
 #include "helpers.h"
+#include "trace.h"
 
-DbaseReader::DbaseReader(const QString &i_file):
+DbaseReader::DbaseReader(const QString &i_file, ReadMode mode):
     file(i_file),
+    mode(mode),
     vals(0),
+    mappedData(0),
+    records(0),
+    nextRecord(0),
     numberOfRecords(0),
     lengthOfHeader(0),
     lengthOfEachRecord(0),
@@ -29,6 +35,10 @@ DbaseReader::~DbaseReader()
     if (vals != 0) {
         delete[] vals;
     }
+
+    if (mappedData != 0) {
+        file.unmap(mappedData);
+    }
 }
 
 QString DbaseReader::getError()
@@ -43,6 +53,11 @@ QString DbaseReader::getFullError()
 
 QString* DbaseReader::getVals()
 {
+    // In mapped mode, the strings are only created if they are requested
+    if (vals == 0 && records != 0) {
+        fillVals();
+    }
+
     return vals;
 }
 
@@ -165,14 +180,61 @@ bool DbaseReader::read()
     }
 
     //rest of header are field information
-    QVector<DbaseField> fields;
     fields.resize(countFields);
+    fieldOffsets.resize(countFields);
+
+    // Each record starts with a one byte deletion flag
+    int offset = 1;
 
     for (int i = 0; i < countFields; i++) {
         fields[i] = DbaseField(file.read(32));
+        fieldOffsets[i] = offset;
+        offset += fields[i].getFieldLength();
         hash[fields[i].getName()] = i;
     }
 
+    // The mapped and streamed records are read at these offsets without any
+    // further check, so that all fields must fit into a record
+    if (offset > lengthOfEachRecord) {
+        error = "Felder laenger als die Records.\nSoll: %1\nIst: %2";
+        error = error.arg(
+            QString::number(lengthOfEachRecord),
+            QString::number(offset)
+        );
+        return false;
+    }
+
+    // Resolve the positions of the required fields once
+    bindFields();
+
+    // Keep the file open, at the start of the first record. The records are
+    // read chunk by chunk (see nextChunk())
+    if (mode == ReadMode::Streamed) {
+
+        if (!file.seek(lengthOfHeader)) {
+            error = "Kann die Datensaetze nicht lesen\n" + file.errorString();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Map the file into memory and keep it open. The cells are decoded on
+    // access (see getFieldView())
+    if (mode == ReadMode::Mapped) {
+
+        mappedData = file.map(0, file.size());
+
+        if (mappedData == 0) {
+            error = "Kann die Datei nicht in den Speicher abbilden\n" +
+                file.errorString();
+            return false;
+        }
+
+        records = (const char*) mappedData + lengthOfHeader;
+        return true;
+    }
+
     //Terminator
     file.read(2);
 
@@ -196,9 +258,9 @@ bool DbaseReader::read()
     return true;
 }
 
-int DbaseReader::expectedFileSize()
+qint64 DbaseReader::expectedFileSize()
 {
-    return lengthOfHeader + (numberOfRecords * lengthOfEachRecord) + 1;
+    return lengthOfHeader + ((qint64) numberOfRecords * lengthOfEachRecord) + 1;
 }
 
 QString DbaseReader::getRecord(int num, const QString & name)
@@ -216,9 +278,77 @@ QString DbaseReader::getRecord(int num, int field)
         return 0;
     }
 
+    if (mode == ReadMode::Mapped) {
+        FieldView view = getFieldView(num, field);
+        int length = qstrnlen(view.data, view.length);
+        return (length > 0) ? QString::fromUtf8(view.data, length) : "0";
+    }
+
+    // In streamed mode, there are no values to return
+    if (vals == 0) {
+        return 0;
+    }
+
     return vals[num * countFields + field];
 }
 
+FieldView DbaseReader::getFieldView(int num, int field)
+{
+    if (field < 0 || field >= countFields) {
+        return {records, 0};
+    }
+
+    return getFieldView(num, {
+        field,
+        fieldOffsets[field],
+        fields[field].getFieldLength(),
+        fields[field].getDecimalCount()
+    });
+}
+
+FieldView DbaseReader::getFieldView(int num, const FieldBinding& field)
+{
+    if (records == 0 || num >= numberOfRecords || field.index < 0) {
+        return {records, 0};
+    }
+
+    return trimmedView(
+        records + (qint64) num * lengthOfEachRecord + field.offset,
+        field.width
+    );
+}
+
+// Skip leading and trailing whitespace, as QByteArray::trimmed() does
+FieldView DbaseReader::trimmedView(const char* data, int length)
+{
+    while (length > 0 && isSpace(data[0])) {
+        data++;
+        length--;
+    }
+
+    while (length > 0 && isSpace(data[length - 1])) {
+        length--;
+    }
+
+    return {data, length};
+}
+
+bool DbaseReader::isSpace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+void DbaseReader::fillVals()
+{
+    vals = new QString[numberOfRecords * countFields];
+
+    for (int i = 0; i < numberOfRecords; i++) {
+        for (int j = 0; j < countFields; j++) {
+            vals[i * countFields + j] = getRecord(i, j);
+        }
+    }
+}
+
 int DbaseReader::getCountFields()
 {
     return countFields;
@@ -298,7 +428,7 @@ QString DbaseReader::checkVersion(quint8 i_byte, bool debug)
     QString result = hash.key(i_byte, "unknown version");
 
     if (debug) {
-        qDebug() << "dbf file version: " << result;
+        TRACE_INFO("dbf file version: " << result);
     }
 
     return result;
@@ -333,7 +463,7 @@ QString DbaseReader::checkLanguageDriver(quint8 i_byte, bool debug)
     QString result = hash.key(i_byte, "unknown language driver");
 
     if (debug) {
-        qDebug() << "dbf language driver: " << result << " (id: " << i_byte << ")";
+        TRACE_INFO("dbf language driver: " << result << " (id: " << i_byte << ")");
     }
 
     return result;
@@ -345,44 +475,350 @@ int DbaseReader::computeCountFields(int headerLength)
     return (headerLength - 32 - 1)/32;
 }
 
+const abimoBinding& DbaseReader::getBinding()
+{
+    return binding;
+}
+
+FieldBinding DbaseReader::bindField(const QString& name)
+{
+    int i = hash.value(name, -1);
+
+    if (i < 0) {
+        return {-1, 0, 0, 0};
+    }
+
+    return {
+        i,
+        fieldOffsets[i],
+        fields[i].getFieldLength(),
+        fields[i].getDecimalCount()
+    };
+}
+
+void DbaseReader::bindFields()
+{
+    binding.NUTZUNG = bindField("NUTZUNG");
+    binding.CODE = bindField("CODE");
+    binding.REGENJA = bindField("REGENJA");
+    binding.REGENSO = bindField("REGENSO");
+    binding.FLUR = bindField("FLUR");
+    binding.TYP = bindField("TYP");
+    binding.FELD_30 = bindField("FELD_30");
+    binding.FELD_150 = bindField("FELD_150");
+    binding.BEZIRK = bindField("BEZIRK");
+    binding.PROBAU = bindField("PROBAU");
+    binding.PROVGU = bindField("PROVGU");
+    binding.VGSTRASSE = bindField("VGSTRASSE");
+    binding.KAN_BEB = bindField("KAN_BEB");
+    binding.KAN_VGU = bindField("KAN_VGU");
+    binding.KAN_STR = bindField("KAN_STR");
+    binding.BELAG1 = bindField("BELAG1");
+    binding.BELAG2 = bindField("BELAG2");
+    binding.BELAG3 = bindField("BELAG3");
+    binding.BELAG4 = bindField("BELAG4");
+    binding.STR_BELAG1 = bindField("STR_BELAG1");
+    binding.STR_BELAG2 = bindField("STR_BELAG2");
+    binding.STR_BELAG3 = bindField("STR_BELAG3");
+    binding.STR_BELAG4 = bindField("STR_BELAG4");
+    binding.FLGES = bindField("FLGES");
+    binding.STR_FLGES = bindField("STR_FLGES");
+}
+
+// The fields are accessed through the binding that was resolved in read(), so
+// that no field name needs to be looked up per record
 void DbaseReader::fillRecord(int k, abimoRecord& record, bool debug)
 {
-    record.BELAG1_fraction = floatFraction(getRecord(k, "BELAG1"));
-    record.BELAG2_fraction = floatFraction(getRecord(k, "BELAG2"));
-    record.BELAG3_fraction = floatFraction(getRecord(k, "BELAG3"));
-    record.BELAG4_fraction = floatFraction(getRecord(k, "BELAG4"));
-    record.BEZIRK = getRecord(k, "BEZIRK").toInt();
-    record.CODE = getRecord(k, "CODE");
-    record.FELD_150 = getRecord(k, "FELD_150").toInt();
-    record.FELD_30 = getRecord(k, "FELD_30").toInt();
-    record.FLGES = getRecord(k, "FLGES").toFloat();
-    record.FLUR = getRecord(k, "FLUR").toFloat();
-    record.KAN_BEB_fraction = floatFraction(getRecord(k, "KAN_BEB"));
-    record.KAN_STR_fraction = floatFraction(getRecord(k, "KAN_STR"));
-    record.KAN_VGU_fraction = floatFraction(getRecord(k, "KAN_VGU"));
-    record.NUTZUNG = Helpers::stringToInt(
-        getRecord(k, "NUTZUNG"),
-        QString("k: %1, NUTZUNG = ").arg(QString::number(k)),
-        debug
+    // Report the conversions only if they are written at all
+    debug = debug && Trace::isEnabled(TraceLevel::Debug);
+
+    record.BELAG1_fraction = floatFraction(k, binding.BELAG1);
+    record.BELAG2_fraction = floatFraction(k, binding.BELAG2);
+    record.BELAG3_fraction = floatFraction(k, binding.BELAG3);
+    record.BELAG4_fraction = floatFraction(k, binding.BELAG4);
+    record.BEZIRK = intValue(k, binding.BEZIRK);
+    record.CODE = stringValue(k, binding.CODE);
+    record.FELD_150 = intValue(k, binding.FELD_150);
+    record.FELD_30 = intValue(k, binding.FELD_30);
+    record.FLGES = floatValue(k, binding.FLGES);
+    record.FLUR = floatValue(k, binding.FLUR);
+    record.KAN_BEB_fraction = floatFraction(k, binding.KAN_BEB);
+    record.KAN_STR_fraction = floatFraction(k, binding.KAN_STR);
+    record.KAN_VGU_fraction = floatFraction(k, binding.KAN_VGU);
+    record.NUTZUNG = !debug ?
+        intValue(k, binding.NUTZUNG) :
+        tracedInt(stringValue(k, binding.NUTZUNG), k, "NUTZUNG");
+    record.PROBAU_fraction = (!debug ?
+        floatValue(k, binding.PROBAU) :
+        tracedFloat(stringValue(k, binding.PROBAU), k, "PROBAU")) / 100.0F;
+    record.PROVGU_fraction = floatFraction(k, binding.PROVGU);
+    record.REGENJA = intValue(k, binding.REGENJA);
+    record.REGENSO = intValue(k, binding.REGENSO);
+    record.STR_BELAG1_fraction = floatFraction(k, binding.STR_BELAG1);
+    record.STR_BELAG2_fraction = floatFraction(k, binding.STR_BELAG2);
+    record.STR_BELAG3_fraction = floatFraction(k, binding.STR_BELAG3);
+    record.STR_BELAG4_fraction = floatFraction(k, binding.STR_BELAG4);
+    record.TYP = intValue(k, binding.TYP);
+    record.VGSTRASSE_fraction = floatFraction(k, binding.VGSTRASSE);
+    record.STR_FLGES = floatValue(k, binding.STR_FLGES);
+}
+
+QString DbaseReader::stringValue(int num, const FieldBinding& field)
+{
+    if (field.index < 0) {
+        return QString();
+    }
+
+    return getRecord(num, field.index);
+}
+
+// In mapped mode, the numbers are converted directly from the mapped bytes,
+// without creating a QString first (see FixedWidthParser)
+int DbaseReader::intValue(int num, const FieldBinding& field)
+{
+    if (field.index < 0) {
+        return 0;
+    }
+
+    if (mode != ReadMode::Mapped) {
+        return getRecord(num, field.index).toInt();
+    }
+
+    FieldView view = getFieldView(num, field);
+
+    return FixedWidthParser::toInt(view.data, view.length);
+}
+
+float DbaseReader::floatValue(int num, const FieldBinding& field)
+{
+    if (field.index < 0) {
+        return 0.0F;
+    }
+
+    if (mode != ReadMode::Mapped) {
+        return getRecord(num, field.index).toFloat();
+    }
+
+    FieldView view = getFieldView(num, field);
+
+    return FixedWidthParser::toFloat(view.data, view.length);
+}
+
+float DbaseReader::floatFraction(int num, const FieldBinding& field)
+{
+    return (floatValue(num, field) / 100.0);
+}
+
+// Convert all required fields once, column by column. The conversions are the
+// same as in fillRecord(). In streamed mode, all records that have not yet
+// been read with nextChunk() are converted.
+void DbaseReader::fillColumns(abimoColumns& columns, bool debug)
+{
+    if (mode == ReadMode::Streamed) {
+        nextChunk(columns, numberOfRecords - nextRecord, debug);
+        return;
+    }
+
+    fillColumns(columns, records, 0, numberOfRecords, debug);
+}
+
+// Convert the next (at most) n records into columns. In streamed mode, the
+// records are read from the file into a buffer that is reused for each chunk.
+// Return the number of converted records (0: no more records, -1: error)
+int DbaseReader::nextChunk(abimoColumns& chunk, int n, bool debug)
+{
+    int count = MIN(n, numberOfRecords - nextRecord);
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    const char* data = 0;
+
+    if (mode == ReadMode::Mapped) {
+        data = records + (qint64) nextRecord * lengthOfEachRecord;
+    }
+    else if (mode == ReadMode::Streamed) {
+
+        qint64 size = (qint64) count * lengthOfEachRecord;
+
+        chunkBuffer.resize((int) size);
+
+        if (file.read(chunkBuffer.data(), size) != size) {
+            error = "Fehler beim Lesen der Datei\n" + file.errorString();
+            return -1;
+        }
+
+        data = chunkBuffer.constData();
+    }
+
+    fillColumns(chunk, data, nextRecord, count, debug);
+
+    nextRecord += count;
+
+    return count;
+}
+
+// Convert count records, starting at record first. data points to the raw
+// bytes of record first (0 in copy mode, where the strings are converted)
+void DbaseReader::fillColumns(
+    abimoColumns& columns, const char* data, int first, int count, bool debug
+)
+{
+    // Report the conversions only if they are written at all
+    debug = debug && Trace::isEnabled(TraceLevel::Debug);
+
+    fillIntColumn(binding.NUTZUNG, columns.NUTZUNG, data, first, count, debug ? "NUTZUNG" : 0);
+    fillStringColumn(binding.CODE, columns.CODE, data, first, count);
+    fillIntColumn(binding.REGENJA, columns.REGENJA, data, first, count);
+    fillIntColumn(binding.REGENSO, columns.REGENSO, data, first, count);
+    fillFloatColumn(binding.FLUR, columns.FLUR, data, first, count);
+    fillIntColumn(binding.TYP, columns.TYP, data, first, count);
+    fillIntColumn(binding.FELD_30, columns.FELD_30, data, first, count);
+    fillIntColumn(binding.FELD_150, columns.FELD_150, data, first, count);
+    fillIntColumn(binding.BEZIRK, columns.BEZIRK, data, first, count);
+
+    // PROBAU is divided by a float (not a double) 100, as in fillRecord()
+    fillFloatColumn(binding.PROBAU, columns.PROBAU_fraction, data, first, count, debug ? "PROBAU" : 0);
+
+    for (int k = 0; k < count; k++) {
+        columns.PROBAU_fraction[k] /= 100.0F;
+    }
+
+    fillFractionColumn(binding.PROVGU, columns.PROVGU_fraction, data, first, count);
+    fillFractionColumn(binding.VGSTRASSE, columns.VGSTRASSE_fraction, data, first, count);
+    fillFractionColumn(binding.KAN_BEB, columns.KAN_BEB_fraction, data, first, count);
+    fillFractionColumn(binding.KAN_VGU, columns.KAN_VGU_fraction, data, first, count);
+    fillFractionColumn(binding.KAN_STR, columns.KAN_STR_fraction, data, first, count);
+    fillFractionColumn(binding.BELAG1, columns.BELAG1_fraction, data, first, count);
+    fillFractionColumn(binding.BELAG2, columns.BELAG2_fraction, data, first, count);
+    fillFractionColumn(binding.BELAG3, columns.BELAG3_fraction, data, first, count);
+    fillFractionColumn(binding.BELAG4, columns.BELAG4_fraction, data, first, count);
+    fillFractionColumn(binding.STR_BELAG1, columns.STR_BELAG1_fraction, data, first, count);
+    fillFractionColumn(binding.STR_BELAG2, columns.STR_BELAG2_fraction, data, first, count);
+    fillFractionColumn(binding.STR_BELAG3, columns.STR_BELAG3_fraction, data, first, count);
+    fillFractionColumn(binding.STR_BELAG4, columns.STR_BELAG4_fraction, data, first, count);
+    fillFloatColumn(binding.FLGES, columns.FLGES, data, first, count);
+    fillFloatColumn(binding.STR_FLGES, columns.STR_FLGES, data, first, count);
+}
+
+// Cell of a bound field in the record that starts at data, converted to a
+// string in the same way as in read()
+QString DbaseReader::cellString(const char* data, const FieldBinding& field)
+{
+    FieldView view = trimmedView(data + field.offset, field.width);
+
+    int length = qstrnlen(view.data, view.length);
+
+    return (length > 0) ? QString::fromUtf8(view.data, length) : "0";
+}
+
+void DbaseReader::fillStringColumn(
+    const FieldBinding& field, QVector<QString>& column,
+    const char* data, int first, int count
+)
+{
+    column.resize(count);
+
+    for (int k = 0; k < count; k++) {
+        column[k] = (data == 0 || field.index < 0) ?
+            stringValue(first + k, field) :
+            cellString(data + (qint64) k * lengthOfEachRecord, field);
+    }
+}
+
+// If a name is given, the conversions are reported (trace level Debug)
+void DbaseReader::fillIntColumn(
+    const FieldBinding& field, QVector<int>& column,
+    const char* data, int first, int count, const char* name
+)
+{
+    column.resize(count);
+
+    if (data == 0 || field.index < 0) {
+        for (int k = 0; k < count; k++) {
+            column[k] = intValue(first + k, field);
+        }
+    }
+    else if (name == 0) {
+        FixedWidthParser::toIntColumn(
+            data + field.offset, lengthOfEachRecord, count, field.width,
+            column.data()
+        );
+    }
+    else {
+        for (int k = 0; k < count; k++) {
+            column[k] = tracedInt(
+                cellString(data + (qint64) k * lengthOfEachRecord, field),
+                first + k, name
+            );
+        }
+    }
+}
+
+void DbaseReader::fillFloatColumn(
+    const FieldBinding& field, QVector<float>& column,
+    const char* data, int first, int count, const char* name
+)
+{
+    column.resize(count);
+
+    if (data == 0 || field.index < 0) {
+        for (int k = 0; k < count; k++) {
+            column[k] = floatValue(first + k, field);
+        }
+    }
+    else if (name == 0) {
+        FixedWidthParser::toFloatColumn(
+            data + field.offset, lengthOfEachRecord, count, field.width,
+            column.data()
+        );
+    }
+    else {
+        for (int k = 0; k < count; k++) {
+            column[k] = tracedFloat(
+                cellString(data + (qint64) k * lengthOfEachRecord, field),
+                first + k, name
+            );
+        }
+    }
+}
+
+// Convert the cell of field name in record k, reporting the conversion (as
+// Helpers::stringToInt() and Helpers::stringToFloat() but the message is only
+// composed if it is written)
+int DbaseReader::tracedInt(const QString& string, int k, const char* name)
+{
+    int result = string.toInt();
+
+    TRACE_DEBUG(
+        QString("k: %1, %2 = ").arg(QString::number(k), name) << result <<
+        QString("(= %1.toInt())").arg(Helpers::singleQuote(string))
     );
-    record.PROBAU_fraction = Helpers::stringToFloat(
-        getRecord(k, "PROBAU"),
-        QString("k: %1, PROBAU = ").arg(QString::number(k)),
-        debug
-    ) / 100.0F;
-    record.PROVGU_fraction = floatFraction(getRecord(k, "PROVGU"));
-    record.REGENJA = getRecord(k, "REGENJA").toInt();
-    record.REGENSO = getRecord(k, "REGENSO").toInt();
-    record.STR_BELAG1_fraction = floatFraction(getRecord(k, "STR_BELAG1"));
-    record.STR_BELAG2_fraction = floatFraction(getRecord(k, "STR_BELAG2"));
-    record.STR_BELAG3_fraction = floatFraction(getRecord(k, "STR_BELAG3"));
-    record.STR_BELAG4_fraction = floatFraction(getRecord(k, "STR_BELAG4"));
-    record.TYP = getRecord(k, "TYP").toInt();
-    record.VGSTRASSE_fraction = floatFraction(getRecord(k, "VGSTRASSE"));
-    record.STR_FLGES = getRecord(k, "STR_FLGES").toFloat();
-}
-
-float DbaseReader::floatFraction(QString string)
-{
-    return (string.toFloat() / 100.0);
+
+    return result;
+}
+
+float DbaseReader::tracedFloat(const QString& string, int k, const char* name)
+{
+    float result = string.toFloat();
+
+    TRACE_DEBUG(
+        QString("k: %1, %2 = ").arg(QString::number(k), name) << result <<
+        QString("(= %1.toFloat())").arg(Helpers::singleQuote(string))
+    );
+
+    return result;
+}
+
+void DbaseReader::fillFractionColumn(
+    const FieldBinding& field, QVector<float>& column,
+    const char* data, int first, int count
+)
+{
+    fillFloatColumn(field, column, data, first, count);
+
+    for (int k = 0; k < count; k++) {
+        column[k] = (column[k] / 100.0);
+    }
 }
@@ -6,10 +6,14 @@
 #ifndef DBASEREADER_H
 #define DBASEREADER_H
 
+#include <QByteArray>
 #include <QDate>
 #include <QFile>
 #include <QHash>
 #include <QString>
+#include <QVector>
+
+#include "dbaseField.h"
 
 // _fraction indicates numbers between 0 and 1 (instead of percentages)
 struct abimoRecord {
@@ -40,11 +44,98 @@ struct abimoRecord {
     float STR_FLGES;
 };
 
+// Required fields of all records, stored column by column in typed arrays
+// (with the same meaning of _fraction as in abimoRecord)
+struct abimoColumns {
+    QVector<int> NUTZUNG;
+    QVector<QString> CODE;
+    QVector<int> REGENJA;
+    QVector<int> REGENSO;
+    QVector<float> FLUR;
+    QVector<int> TYP;
+    QVector<int> FELD_30;
+    QVector<int> FELD_150;
+    QVector<int> BEZIRK;
+    QVector<float> PROBAU_fraction;
+    QVector<float> PROVGU_fraction;
+    QVector<float> VGSTRASSE_fraction;
+    QVector<float> KAN_BEB_fraction;
+    QVector<float> KAN_VGU_fraction;
+    QVector<float> KAN_STR_fraction;
+    QVector<float> BELAG1_fraction;
+    QVector<float> BELAG2_fraction;
+    QVector<float> BELAG3_fraction;
+    QVector<float> BELAG4_fraction;
+    QVector<float> STR_BELAG1_fraction;
+    QVector<float> STR_BELAG2_fraction;
+    QVector<float> STR_BELAG3_fraction;
+    QVector<float> STR_BELAG4_fraction;
+    QVector<float> FLGES;
+    QVector<float> STR_FLGES;
+};
+
+// Position of a field within each record of a dbf file
+struct FieldBinding {
+    // column index (-1 if the field does not exist)
+    int index;
+    // byte offset from the start of the record
+    int offset;
+    // field length and decimal count as given in the header
+    int width;
+    int decimalCount;
+};
+
+// Positions of the required fields (see DbaseReader::requiredFields()),
+// resolved once after reading the header
+struct abimoBinding {
+    FieldBinding NUTZUNG;
+    FieldBinding CODE;
+    FieldBinding REGENJA;
+    FieldBinding REGENSO;
+    FieldBinding FLUR;
+    FieldBinding TYP;
+    FieldBinding FELD_30;
+    FieldBinding FELD_150;
+    FieldBinding BEZIRK;
+    FieldBinding PROBAU;
+    FieldBinding PROVGU;
+    FieldBinding VGSTRASSE;
+    FieldBinding KAN_BEB;
+    FieldBinding KAN_VGU;
+    FieldBinding KAN_STR;
+    FieldBinding BELAG1;
+    FieldBinding BELAG2;
+    FieldBinding BELAG3;
+    FieldBinding BELAG4;
+    FieldBinding STR_BELAG1;
+    FieldBinding STR_BELAG2;
+    FieldBinding STR_BELAG3;
+    FieldBinding STR_BELAG4;
+    FieldBinding FLGES;
+    FieldBinding STR_FLGES;
+};
+
+// How the records of a dbf file are made available after read()
+enum struct ReadMode {
+    // copy all cells into a matrix of strings (see getVals())
+    Copy = 0,
+    // map the file into memory and decode the cells on access
+    Mapped = 1,
+    // only read the header. Read the records chunk by chunk with nextChunk()
+    Streamed = 2
+};
+
+// View into the raw (trimmed) bytes of one cell of a memory mapped file
+struct FieldView {
+    const char* data;
+    int length;
+};
+
 class DbaseReader
 {
 
 public:
-    DbaseReader(const QString&);
+    DbaseReader(const QString&, ReadMode mode = ReadMode::Copy);
     ~DbaseReader();
     bool read();
     QString getVersion();
@@ -56,6 +147,9 @@ public:
     int getCountFields();
     QString getRecord(int num, int field);
     QString getRecord(int num, const QString& name);
+    FieldView getFieldView(int num, int field);
+    FieldView getFieldView(int num, const FieldBinding& field);
+    const abimoBinding& getBinding();
     QString getError();
     QString getFullError();
     static QStringList requiredFields();
@@ -63,19 +157,37 @@ public:
     bool checkAndRead();
     QString* getVals();
     void fillRecord(int k, abimoRecord& record, bool debug = false);
+    void fillColumns(abimoColumns& columns, bool debug = false);
+    int nextChunk(abimoColumns& chunk, int n, bool debug = false);
 
 private:
     // VARIABLES:
     /////////////
     QFile file;
+    ReadMode mode;
     QString version;
     QString languageDriver;
     QDate date;
     QHash<QString, int> hash;
+    abimoBinding binding;
     QString error;
     QString fullError;
     QString* vals;
 
+    // field definitions and offsets of the fields within a record
+    QVector<DbaseField> fields;
+    QVector<int> fieldOffsets;
+
+    // start of the memory mapped file and of its first record
+    uchar* mappedData;
+    const char* records;
+
+    // streamed mode: buffer for one chunk of records
+    QByteArray chunkBuffer;
+
+    // index of the record that nextChunk() returns first
+    int nextRecord;
+
     // count of records in file
     int numberOfRecords;
 
@@ -91,7 +203,7 @@ private:
     // FUNCTIONS:
     /////////////
 
-    int expectedFileSize();
+    qint64 expectedFileSize();
 
     // 1 byte unsigned give the version
     QString checkVersion(quint8, bool debug = true);
@@ -111,8 +223,36 @@ private:
     // compute the count of fields
     int computeCountFields(int);
 
-    // convert string to float and divide by 100
-    float floatFraction(QString string);
+    // whitespace as removed by QByteArray::trimmed()
+    static bool isSpace(char c);
+    static FieldView trimmedView(const char* data, int length);
+
+    // resolve the position of a field (binding) by its name
+    FieldBinding bindField(const QString& name);
+    void bindFields();
+
+    // convert the cell of a bound field in row num to string, int or float
+    // (fraction: divide by 100)
+    QString stringValue(int num, const FieldBinding& field);
+    int intValue(int num, const FieldBinding& field);
+    float floatValue(int num, const FieldBinding& field);
+    float floatFraction(int num, const FieldBinding& field);
+
+    // convert count cells of a bound field, starting in record first. data
+    // points to the raw bytes of record first (0: convert the strings of the
+    // copy mode). If a name is given, the conversions are reported (trace
+    // level Debug)
+    void fillColumns(abimoColumns& columns, const char* data, int first, int count, bool debug);
+    QString cellString(const char* data, const FieldBinding& field);
+    void fillStringColumn(const FieldBinding& field, QVector<QString>& column, const char* data, int first, int count);
+    void fillIntColumn(const FieldBinding& field, QVector<int>& column, const char* data, int first, int count, const char* name = 0);
+    void fillFloatColumn(const FieldBinding& field, QVector<float>& column, const char* data, int first, int count, const char* name = 0);
+    void fillFractionColumn(const FieldBinding& field, QVector<float>& column, const char* data, int first, int count);
+    static int tracedInt(const QString& string, int k, const char* name);
+    static float tracedFloat(const QString& string, int k, const char* name);
+
+    // create the matrix of strings from the memory mapped records
+    void fillVals();
 };
 
 #endif
@@ -3,7 +3,9 @@
  * of this repository (https://github.com/KWB-R/abimo).
  ***************************************************************************/
 
-#include <math.h>
+#include <string.h> // for memcpy()
+#include <thread>
+#include <vector>
 #include <QByteArray>
 #include <QChar>
 #include <QDateTime>
@@ -11,15 +13,26 @@
 #include <QHash>
 #include <QIODevice>
 #include <QString>
-#include <QStringList>
+#include <QThread>
 #include <QTextStream>
 #include <QVector>
 
 #include "dbaseWriter.h"
+#include "fixedWidthEncoder.h"
 #include "initvalues.h"
 
-DbaseWriter::DbaseWriter(QString &file, InitValues &initValues):
+// Number of bytes of rows that are collected before writing them to the file
+// in streaming mode
+#define WRITE_BUFFER_SIZE 65536
+
+// Minimum number of rows for each thread that encodes into the mapped file
+#define MIN_RECORDS_PER_THREAD 10000
+
+DbaseWriter::DbaseWriter(QString &file, InitValues &initValues, WriteMode mode):
     fileName(file),
+    mode(mode),
+    outFile(file),
+    overflowCount(0),
     recNum(0)
 {
     // Felder mit Namen, Typ, Nachkommastellen
@@ -34,11 +47,6 @@ DbaseWriter::DbaseWriter(QString &file, InitValues &initValues):
     fields[8].set("VERDUNSTUN", "N", initValues.getDecVERDUNSTUNG());
 
     this->date = QDateTime::currentDateTime().date();
-
-    // Fill the hash that assigns field numbers to field names
-    for (int i = 0; i < countFields; i++) {
-        hash[fields[i].getName()] = i;
-    }
 }
 
 QString DbaseWriter::getError()
@@ -46,10 +54,97 @@ QString DbaseWriter::getError()
     return error;
 }
 
+// Fix the widths of all fields before streaming: CODE gets codeWidth
+// characters, numeric fields get integerWidth characters (including a minus
+// sign) before the decimal point plus the point and the configured decimals
+void DbaseWriter::setFieldWidths(int codeWidth, int integerWidth)
+{
+    fields[0].setFieldLength(codeWidth);
+
+    for (int i = 1; i < countFields; i++) {
+        int decimalCount = fields[i].getDecimalCount();
+        fields[i].setFieldLength(
+            integerWidth + ((decimalCount > 0) ? decimalCount + 1 : 0)
+        );
+    }
+}
+
+// In streaming mode, create the file and write the header. The number of
+// records in the header is updated in write().
+bool DbaseWriter::open()
+{
+    if (mode != WriteMode::Stream) {
+        return true;
+    }
+
+    if (!outFile.open(QIODevice::WriteOnly)) {
+        error = "kann Out-Datei: '" + fileName + "' nicht oeffnen\n Grund: " + outFile.errorString();
+        return false;
+    }
+
+    QByteArray data;
+    data.resize(lengthOfHeader);
+    writeFileHeader(data);
+
+    buffer.reserve(WRITE_BUFFER_SIZE + lengthOfEachRecord);
+    buffer.append(data);
+
+    return flush();
+}
+
+// In streaming mode, close and remove the unfinished file
+void DbaseWriter::abort()
+{
+    if (mode == WriteMode::Stream && outFile.isOpen()) {
+        outFile.close();
+        outFile.remove();
+    }
+}
+
+bool DbaseWriter::flush()
+{
+    if (outFile.write(buffer) != buffer.size()) {
+        error = "kann nicht in Out-Datei: '" + fileName + "' schreiben\n Grund: " + outFile.errorString();
+        return false;
+    }
+
+    // Keeps the reserved capacity
+    buffer.resize(0);
+
+    return true;
+}
+
 bool DbaseWriter::write()
 {
     QByteArray data;
 
+    if (mode == WriteMode::Stream) {
+
+        // Finish the file and set the number of records in the header
+        buffer.append(QChar(0x1A));
+        data.resize(4);
+        writeFourByteInteger(data, 0, recNum);
+
+        bool success = error.isEmpty() && flush() && outFile.seek(4) && outFile.write(data) == 4;
+
+        if (!success && error.isEmpty()) {
+            error = "kann Out-Datei: '" + fileName + "' nicht abschliessen\n Grund: " + outFile.errorString();
+        }
+
+        outFile.close();
+
+        if (success && overflowCount > 0) {
+            error = QString("%1 Werte passen nicht in die Feldbreite").arg(overflowCount);
+            success = false;
+        }
+
+        return success;
+    }
+
+    if (mode == WriteMode::Mapped) {
+        return writeMapped();
+    }
+
     data.resize(lengthOfHeader);
 
     // Write the file header containing e.g. names and types of fields
@@ -71,6 +166,77 @@ bool DbaseWriter::write()
     return true;
 }
 
+// Size the file to its final length, map it into memory and let several
+// threads encode disjoint ranges of rows directly into place
+bool DbaseWriter::writeMapped()
+{
+    QByteArray header;
+    header.resize(lengthOfHeader);
+
+    // Also determines lengthOfEachRecord
+    writeFileHeader(header);
+
+    qint64 size = lengthOfHeader + (qint64) recNum * lengthOfEachRecord + 1;
+
+    if (!outFile.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+        !outFile.resize(size))
+    {
+        error = "kann Out-Datei: '" + fileName + "' nicht oeffnen\n Grund: " + outFile.errorString();
+        return false;
+    }
+
+    uchar* data = outFile.map(0, size);
+
+    if (data == 0) {
+        error = "kann Out-Datei: '" + fileName + "' nicht abbilden\n Grund: " + outFile.errorString();
+        outFile.close();
+        return false;
+    }
+
+    memcpy(data, header.constData(), lengthOfHeader);
+
+    // Give each thread at least MIN_RECORDS_PER_THREAD rows
+    int threadCount = qBound(1, recNum / MIN_RECORDS_PER_THREAD, QThread::idealThreadCount());
+    int perThread = (recNum + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+
+    for (int first = perThread; first < recNum; first += perThread) {
+        threads.emplace_back(
+            &DbaseWriter::encodeRecords, this, data, first, qMin(perThread, recNum - first)
+        );
+    }
+
+    // The first range is encoded by the calling thread
+    encodeRecords(data, 0, qMin(perThread, recNum));
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    data[size - 1] = 0x1A;
+
+    bool success = outFile.unmap(data);
+    outFile.close();
+
+    if (!success) {
+        error = "kann Out-Datei: '" + fileName + "' nicht schreiben\n Grund: " + outFile.errorString();
+    }
+
+    return success;
+}
+
+// Encode count rows starting at row first into the memory starting at data
+// (the file header). Only reads members, so that it can run in parallel.
+void DbaseWriter::encodeRecords(uchar* data, int first, int count)
+{
+    char* row = (char*) data + lengthOfHeader + (qint64) first * lengthOfEachRecord;
+
+    for (int rec = first; rec < first + count; rec++) {
+        encodeRecord(row, records.at(rec));
+        row += lengthOfEachRecord;
+    }
+}
+
 int DbaseWriter::writeFileHeader(QByteArray &data)
 {
     int index = 0;
@@ -134,38 +300,53 @@ int DbaseWriter::writeFileHeader(QByteArray &data)
 
 void DbaseWriter::writeFileData(QByteArray &data)
 {
-    QVector<QString> strings;
+    int index = data.size();
+
+    // All rows have the same length, so that the data can be written in place
+    data.resize(index + recNum * lengthOfEachRecord + 1);
 
     for (int rec = 0; rec < recNum; rec++) {
+        encodeRecord(data.data() + index, records.at(rec));
+        index += lengthOfEachRecord;
+    }
+
+    data[index] = 0x1A;
+}
+
+// Write one row of lengthOfEachRecord bytes. Return the number of values that
+// do not fit into their fields.
+int DbaseWriter::encodeRecord(char* row, const abimoOutputRecord& record)
+{
+    const float values[countFields - 1] = {
+        record.R, record.ROW, record.RI, record.RVOL, record.ROWVOL,
+        record.RIVOL, record.FLAECHE, record.VERDUNSTUN
+    };
+
+    int overflows = 0;
+
+    // Blank = the record is not deleted
+    *row++ = ' ';
+
+    if (!FixedWidthEncoder::encodeString(row, fields[0].getFieldLength(), record.CODE)) {
+        overflows++;
+    }
+
+    row += fields[0].getFieldLength();
 
-        strings = record.at(rec);
-        data.append(QChar(0x20));
-
-        for (int field = 0; field < countFields; field++) {
-
-            int fieldLength = fields[field].getFieldLength();
-
-            if (fields[field].getDecimalCount() > 0) {
-                QString str = strings.at(field);
-                QStringList strlist = str.split(".");
-                int frontLength = fieldLength - 1 - fields[field].getDecimalCount();
-                if (strlist.at(0).contains('-')) {
-                    data.append(QString("-"));
-                    data.append(strlist.at(0).right(strlist.at(0).length() - 1).rightJustified(frontLength-1, QChar(0x30)));
-                }
-                else {
-                    data.append(strlist.at(0).rightJustified(frontLength, QChar(0x30)));
-                }
-                data.append(".");
-                data.append(strlist.at(1).leftJustified(fields[field].getDecimalCount(), QChar(0x30)));
-            }
-            else {
-                data.append(strings.at(field).rightJustified(fieldLength, QChar(0x30)));
-            }
+    for (int field = 1; field < countFields; field++) {
+
+        int fieldLength = fields[field].getFieldLength();
+
+        if (!FixedWidthEncoder::encodeNumber(
+            row, fieldLength, values[field - 1], fields[field].getDecimalCount()
+        )) {
+            overflows++;
         }
+
+        row += fieldLength;
     }
 
-    data.append(QChar(0x1A));
+    return overflows;
 }
 
 int DbaseWriter::writeBytes(QByteArray &data, int index, int value, int n_values)
@@ -214,45 +395,50 @@ int DbaseWriter::writeTwoByteInteger(QByteArray &data, int index, int value)
     return index + 2;
 }
 
-void DbaseWriter::addRecord()
+void DbaseWriter::addRecord(const abimoOutputRecord& record)
 {
-    QVector<QString> v(countFields);
-    record.append(v);
-    recNum ++;
-}
+    if (mode == WriteMode::Stream) {
 
-void DbaseWriter::setRecordField(int num, QString value)
-{
-    ((record.last()))[num] = QString(value);
-    if (value.size() > fields[num].getFieldLength()) {
-        fields[num].setFieldLength(value.size());
-    }
-}
+        int index = buffer.size();
+
+        // Does not allocate: the capacity of the buffer is reserved in open()
+        buffer.resize(index + lengthOfEachRecord);
+
+        // The widths are fixed: values that do not fit are marked with '*'
+        overflowCount += encodeRecord(buffer.data() + index, record);
+        recNum++;
 
-void DbaseWriter::setRecordField(int num, float value)
-{    
-    int decimalCount = fields[num].getDecimalCount();
+        // An error is kept in getError() and reported again by write()
+        if (buffer.size() >= WRITE_BUFFER_SIZE) {
+            flush();
+        }
 
-    // round
-    value *= pow(10, decimalCount);
-    value = round(value);
-    value *= pow(10, -decimalCount);
+        return;
+    }
 
-    QString valueStr;
-    valueStr.setNum(value, 'f', decimalCount);
-    setRecordField(num, valueStr);
+    records.append(record);
+    recNum++;
+
+    // Each field is as wide as its longest value
+    widenField(0, FixedWidthEncoder::stringLength(record.CODE));
+    widenField(1, numberLength(1, record.R));
+    widenField(2, numberLength(2, record.ROW));
+    widenField(3, numberLength(3, record.RI));
+    widenField(4, numberLength(4, record.RVOL));
+    widenField(5, numberLength(5, record.ROWVOL));
+    widenField(6, numberLength(6, record.RIVOL));
+    widenField(7, numberLength(7, record.FLAECHE));
+    widenField(8, numberLength(8, record.VERDUNSTUN));
 }
 
-void DbaseWriter::setRecordField(QString name, QString value)
+int DbaseWriter::numberLength(int field, float value)
 {
-    if (hash.contains(name)) {
-        setRecordField(hash[name], value);
-    }
+    return FixedWidthEncoder::numberLength(value, fields[field].getDecimalCount());
 }
 
-void DbaseWriter::setRecordField(QString name, float value)
+void DbaseWriter::widenField(int field, int length)
 {
-    if (hash.contains(name)) {
-        setRecordField(hash[name], value);
+    if (length > fields[field].getFieldLength()) {
+        fields[field].setFieldLength(length);
     }
 }
@@ -8,7 +8,7 @@
 
 #include <QByteArray>
 #include <QDate>
-#include <QHash>
+#include <QFile>
 #include <QString>
 #include <QVector>
 
@@ -18,30 +18,64 @@
 const int countFields = 9;
 const int lengthOfHeader = countFields * 32 + 32 + 1;
 
+// Calculated values of one block partial area (one row of the output dbf file)
+struct abimoOutputRecord {
+    QString CODE;
+    float R;
+    float ROW;
+    float RI;
+    float RVOL;
+    float ROWVOL;
+    float RIVOL;
+    float FLAECHE;
+    float VERDUNSTUN;
+};
+
+// How the rows given to a DbaseWriter get into the file
+enum struct WriteMode {
+    // collect all rows and write the file in write(), with each field as wide
+    // as its longest value
+    Collect = 0,
+    // write each row as soon as it is added, with field widths fixed by
+    // setFieldWidths() before open()
+    Stream = 1,
+    // collect all rows like Collect, then encode them in parallel directly
+    // into the memory mapped file in write()
+    Mapped = 2
+};
+
 class DbaseWriter
 {
 
 public:
-    DbaseWriter(QString &file, InitValues &initValues);
+    DbaseWriter(QString &file, InitValues &initValues, WriteMode mode = WriteMode::Collect);
+    void setFieldWidths(int codeWidth, int integerWidth);
+    bool open();
     bool write();
-    void addRecord();
-    void setRecordField(int num, QString value);
-    void setRecordField(QString name, QString value);
-    void setRecordField(int num, float value);
-    void setRecordField(QString name, float value);
+    void abort();
+    void addRecord(const abimoOutputRecord& record);
     QString getError();
 
 private:
     QString fileName;
-    QVector< QVector<QString> > record;
+    WriteMode mode;
+    QFile outFile;
+    QByteArray buffer;
+    int overflowCount;
+    QVector<abimoOutputRecord> records;
     QDate date;
-    QHash<QString, int> hash;
     QString error;
     int lengthOfEachRecord;
     int recNum;
     DbaseField fields[countFields];
     int writeFileHeader(QByteArray &data);
     void writeFileData(QByteArray &data);
+    bool writeMapped();
+    void encodeRecords(uchar* data, int first, int count);
+    int encodeRecord(char* row, const abimoOutputRecord& record);
+    int numberLength(int field, float value);
+    void widenField(int field, int length);
+    bool flush();
     int writeBytes(QByteArray &data, int index, int value, int n_values);
     int writeThreeByteDate(QByteArray &data, int index, QDate date);
     int writeFourByteInteger(QByteArray &data, int index, int value);
@@ -1,11 +1,15 @@
+#include <QVector>
+
 #include "effectivenessunsealed.h"
 
+#include "config.h"
 #include "constants.h"
+#include "helpers.h"
 #include "pdr.h"
 
 // parameter values x1, x2, x3, x4 and x5 (one column each)
 // for calculating the effectiveness parameter n for unsealed surfaces
-const float EffectivenessUnsealed::EKA[]= {
+constexpr float EffectivenessUnsealed::EKA[]= {
     0.04176F, -0.647F , 0.218F  ,  0.01472F, 0.0002089F,
     0.04594F, -0.314F , 0.417F  ,  0.02463F, 0.0001143F,
     0.05177F, -0.010F , 0.596F  ,  0.02656F, 0.0002786F,
@@ -32,25 +36,40 @@ EffectivenessUnsealed::EffectivenessUnsealed()
  */
 float EffectivenessUnsealed::getNUV(PDR &record)
 {
-    float G020 = getG02((int) (record.nFK + 0.5));
-    Usage usage = record.NUT;
+    return getNUV(
+        (int) (record.nFK + 0.5),
+        {record.NUT, record.ERT, record.BER},
+        (record.P1S == 0 && record.ETPS == 0)
+    );
+}
+
+// Same for the rounded nFK and the usage, yield and irrigation of a tuple
+float EffectivenessUnsealed::getNUV(int nFK, UsageTuple tuple, bool notSummer)
+{
+    float G020 = getG02(nFK);
 
-    if (usage == Usage::forested_W) {
+    if (tuple.usage == Usage::forested_W) {
         return bag0_forest(G020);
     }
 
-    return bag0_default(G020, record.ERT, record.BER, (record.P1S == 0 && record.ETPS == 0));
+    return bag0_default(G020, tuple.yield, tuple.irrigation, notSummer);
 }
 
 float EffectivenessUnsealed::getG02(int nFK)
 {
-    const float G02tab [] = {
+    static constexpr float G02tab [] = {
         0.0F,   0.0F,  0.0F,  0.0F,  0.3F,  0.8F,  1.4F,  2.4F,  3.7F,  5.0F,
         6.3F,   7.7F,  9.3F, 11.0F, 12.4F, 14.7F, 17.4F, 21.0F, 26.0F, 32.0F,
         39.4F, 44.7F, 48.0F, 50.7F, 52.7F, 54.0F, 55.0F, 55.0F, 55.0F, 55.0F, 55.0F
     };
 
-    return G02tab[nFK];
+    static_assert(
+        Helpers::length(G02tab) == nFKCount,
+        "G02tab must have a value for each rounded nFK from 0 to nFKCount - 1"
+    );
+
+    // nFK beyond the table (not expected) gets the value of the nearest end
+    return G02tab[(nFK < 0) ? 0 : (nFK >= nFKCount) ? nFKCount - 1 : nFK];
 }
 
 float EffectivenessUnsealed::bag0_forest(float G020)
@@ -84,6 +103,9 @@ float EffectivenessUnsealed::bag0_default(float G020, int yield, int irrigation,
 
     k = 5 * MIN(k, 13) - 2;
 
+    // k is between 3 and 63, EKA[k - 3] to EKA[k + 1] are read
+    static_assert(Helpers::length(EKA) == 13 * 5, "EKA must have 13 rows of 5 values");
+
     result = EKA[k - 1] + EKA[k] * G020 + EKA[k + 1] * G020 * G020;
 
     condition_1 = (result >= 2.0) && (yield < 60);
@@ -105,3 +127,49 @@ float EffectivenessUnsealed::nonSummerCorrected(float x, int irrigation)
 {
     return x * (0.9985F + 0.00284F * irrigation - 0.00000379762F * irrigation * irrigation);
 }
+
+EffectivenessTable::EffectivenessTable()
+{
+}
+
+// =============================================================================
+// Calculates the values for the tuples of config. With BERtoZero the kernel
+// sets the irrigation of each record to 0, so the values are calculated
+// without irrigation, too.
+// =============================================================================
+void EffectivenessTable::build(const Config& config, bool BERtoZero)
+{
+    int tupleCount = config.getUsageTupleCount();
+
+    values.resize(tupleCount * EffectivenessUnsealed::nFKCount * 2);
+
+    for (int t = 0; t < tupleCount; t++) {
+
+        UsageTuple tuple = config.getUsageTuple(t);
+
+        if (BERtoZero) {
+            tuple.irrigation = 0;
+        }
+
+        for (int nFK = 0; nFK < EffectivenessUnsealed::nFKCount; nFK++) {
+            for (int notSummer = 0; notSummer < 2; notSummer++) {
+                values[(t * EffectivenessUnsealed::nFKCount + nFK) * 2 + notSummer] =
+                    EffectivenessUnsealed::getNUV(nFK, tuple, notSummer == 1);
+            }
+        }
+    }
+}
+
+// Value for the tuple, the rounded nFK and notSummer. Returns false if the
+// table does not contain it.
+bool EffectivenessTable::lookup(int tupleIndex, int nFK, bool notSummer, float& value) const
+{
+    int index = (tupleIndex * EffectivenessUnsealed::nFKCount + nFK) * 2 + (notSummer ? 1 : 0);
+
+    if (nFK < 0 || nFK >= EffectivenessUnsealed::nFKCount || index < 0 || index >= values.size()) {
+        return false;
+    }
+
+    value = values[index];
+    return true;
+}
@@ -1,6 +1,9 @@
 #ifndef EFFECTIVENESSUNSEALED_H
 #define EFFECTIVENESSUNSEALED_H
 
+#include <QVector>
+
+#include "config.h"
 #include "pdr.h"
 
 class EffectivenessUnsealed
@@ -15,6 +18,25 @@ private:
 public:
     EffectivenessUnsealed();
     static float getNUV(PDR &record);
+    static float getNUV(int nFK, UsageTuple tuple, bool notSummer);
+
+    // Number of values of the rounded nFK (0 to 30)
+    const static int nFKCount = 31;
+};
+
+// Values of EffectivenessUnsealed::getNUV() for all (usage, yield,
+// irrigation)-tuples of a Config, rounded values of nFK and with and without
+// summer values. They are calculated once per calculation, the kernel then
+// only reads them.
+class EffectivenessTable
+{
+public:
+    EffectivenessTable();
+    void build(const Config& config, bool BERtoZero);
+    bool lookup(int tupleIndex, int nFK, bool notSummer, float& value) const;
+
+private:
+    QVector<float> values;
 };
 
 #endif // EFFECTIVENESSUNSEALED_H
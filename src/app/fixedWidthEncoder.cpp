@@ -0,0 +1,218 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#include <math.h>
+#include <string.h> // for memcpy(), memset()
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+#include "fixedWidthEncoder.h"
+
+// Maximum number of characters of a formatted number (the length of a dBase
+// field is stored in one byte)
+#define MAX_LENGTH 255
+
+// Maximum number of decimals that are formatted with integer arithmetic: the
+// 24 bit mantissa of a float times 10^9 still fits into 54 bits
+#define MAX_DECIMALS 9
+
+const quint64 FixedWidthEncoder::powersOfTen[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL
+};
+
+FixedWidthEncoder::FixedWidthEncoder()
+{
+}
+
+int FixedWidthEncoder::numberLength(float value, int decimalCount)
+{
+    char buffer[MAX_LENGTH];
+
+    return format(value, decimalCount, buffer);
+}
+
+// Number of bytes: only ASCII characters are one byte each
+int FixedWidthEncoder::stringLength(const QString& value)
+{
+    const QChar* chars = value.constData();
+
+    for (int i = 0; i < value.size(); i++) {
+        if (chars[i].unicode() >= 0x80) {
+            return value.toUtf8().size();
+        }
+    }
+
+    return value.size();
+}
+
+// A negative number with decimals keeps its sign in front of the leading
+// zeros, a negative number without decimals gets the zeros in front of the
+// sign (as with QString::rightJustified() on the whole string)
+bool FixedWidthEncoder::encodeNumber(char* out, int width, float value, int decimalCount)
+{
+    char buffer[MAX_LENGTH];
+    int length = format(value, decimalCount, buffer);
+
+    if (length > width) {
+        return overflow(out, width);
+    }
+
+    int zeros = width - length;
+
+    if (decimalCount > 0 && buffer[0] == '-') {
+        out[0] = '-';
+        memset(out + 1, '0', zeros);
+        memcpy(out + 1 + zeros, buffer + 1, length - 1);
+    }
+    else {
+        memset(out, '0', zeros);
+        memcpy(out + zeros, buffer, length);
+    }
+
+    return true;
+}
+
+bool FixedWidthEncoder::encodeString(char* out, int width, const QString& value)
+{
+    const QChar* chars = value.constData();
+    int length = value.size();
+
+    for (int i = 0; i < length; i++) {
+        if (chars[i].unicode() >= 0x80) {
+
+            // Rare: let Qt do the conversion
+            QByteArray bytes = value.toUtf8();
+
+            if (bytes.size() > width) {
+                return overflow(out, width);
+            }
+
+            memset(out, '0', width - bytes.size());
+            memcpy(out + width - bytes.size(), bytes.constData(), bytes.size());
+
+            return true;
+        }
+    }
+
+    if (length > width) {
+        return overflow(out, width);
+    }
+
+    memset(out, '0', width - length);
+
+    for (int i = 0; i < length; i++) {
+        out[width - length + i] = (char) chars[i].unicode();
+    }
+
+    return true;
+}
+
+// The rounding that DbaseWriter has always applied before formatting. Keep
+// the single steps (float value, double powers of ten) to get the same floats.
+float FixedWidthEncoder::roundToDecimals(float value, int decimalCount)
+{
+    value *= pow(10, decimalCount);
+    value = ::round(value);
+    value *= pow(10, -decimalCount);
+
+    return value;
+}
+
+// Write the rounded value to buffer as QString::setNum(value, 'f',
+// decimalCount) does and return the number of characters. The float is
+// exactly m * 2^e with an integer m < 2^24, so that value * 10^decimalCount
+// can be rounded exactly, half away from zero like Qt does.
+int FixedWidthEncoder::format(float value, int decimalCount, char* buffer)
+{
+    value = roundToDecimals(value, decimalCount);
+
+    if (!qIsFinite(value) || decimalCount < 0 || decimalCount > MAX_DECIMALS) {
+        return fallbackFormat(value, decimalCount, buffer);
+    }
+
+    int exponent;
+    double fraction = frexp(fabs((double) value), &exponent);
+    quint64 mantissa = (quint64) ldexp(fraction, 24);
+    int shift = exponent - 24;
+
+    // Does not overflow: mantissa * 10^decimalCount < 2^54
+    quint64 scaled = mantissa * powersOfTen[decimalCount];
+
+    if (shift > 63 - 54) {
+        return fallbackFormat(value, decimalCount, buffer);
+    }
+
+    if (shift >= 0) {
+        scaled <<= shift;
+    }
+    else if (shift < -63) {
+        // Less than half of the last decimal
+        scaled = 0;
+    }
+    else {
+        scaled = (scaled + (1ULL << (-shift - 1))) >> -shift;
+    }
+
+    int length = 0;
+
+    // Qt prints a minus sign for all negative values, but not for -0.0
+    if (value < 0) {
+        buffer[length++] = '-';
+    }
+
+    length += writeDigits(scaled / powersOfTen[decimalCount], 1, buffer + length);
+
+    if (decimalCount > 0) {
+        buffer[length++] = '.';
+        length += writeDigits(
+            scaled % powersOfTen[decimalCount], decimalCount, buffer + length
+        );
+    }
+
+    return length;
+}
+
+// Rare: numbers that are too big and too many decimals
+int FixedWidthEncoder::fallbackFormat(float value, int decimalCount, char* buffer)
+{
+    QByteArray bytes = QByteArray::number((double) value, 'f', decimalCount);
+    int length = qMin(bytes.size(), MAX_LENGTH);
+
+    memcpy(buffer, bytes.constData(), length);
+
+    return length;
+}
+
+// Write the decimal digits of value, with leading zeros up to minDigits
+int FixedWidthEncoder::writeDigits(quint64 value, int minDigits, char* buffer)
+{
+    char digits[20];
+    int count = 0;
+
+    do {
+        digits[count++] = (char) ('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    while (count < minDigits) {
+        digits[count++] = '0';
+    }
+
+    for (int i = 0; i < count; i++) {
+        buffer[i] = digits[count - 1 - i];
+    }
+
+    return count;
+}
+
+// dBase marks a value that does not fit into its field with asterisks
+bool FixedWidthEncoder::overflow(char* out, int width)
+{
+    memset(out, '*', width);
+
+    return false;
+}
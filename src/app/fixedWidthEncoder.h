@@ -0,0 +1,40 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#ifndef FIXEDWIDTHENCODER_H
+#define FIXEDWIDTHENCODER_H
+
+#include <QString>
+#include <QtGlobal>
+
+// Conversion of output values to the fixed width cells of a dBase file,
+// directly into the bytes of a row and without creating a QString. The bytes
+// are the same as those that DbaseWriter used to produce by rounding the value
+// to decimalCount decimals, formatting it with QString::setNum(value, 'f',
+// decimalCount) and filling it up with leading zeros.
+class FixedWidthEncoder
+{
+public:
+    FixedWidthEncoder();
+
+    // Number of characters (without filling) of a value
+    static int numberLength(float value, int decimalCount);
+    static int stringLength(const QString& value);
+
+    // Write a value into the width bytes at out. If it does not fit, fill the
+    // cell with '*' and return false
+    static bool encodeNumber(char* out, int width, float value, int decimalCount);
+    static bool encodeString(char* out, int width, const QString& value);
+
+private:
+    const static quint64 powersOfTen[];
+    static float roundToDecimals(float value, int decimalCount);
+    static int format(float value, int decimalCount, char* buffer);
+    static int fallbackFormat(float value, int decimalCount, char* buffer);
+    static int writeDigits(quint64 value, int minDigits, char* buffer);
+    static bool overflow(char* out, int width);
+};
+
+#endif // FIXEDWIDTHENCODER_H
@@ -0,0 +1,200 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#include <string.h> // for memcpy()
+#include <QByteArray>
+#include <QtGlobal>
+
+#include "fixedWidthParser.h"
+
+// Maximum number of digits of a number that is converted here. All integers
+// with up to 15 digits are exactly representable as double
+#define MAX_DIGITS 15
+
+// All powers of ten that are exactly representable as double
+const double FixedWidthParser::powersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+FixedWidthParser::FixedWidthParser()
+{
+}
+
+int FixedWidthParser::toInt(const char* data, int length)
+{
+    quint64 mantissa;
+    int decimals;
+
+    if (!trim(data, length)) {
+        return 0;
+    }
+
+    bool negative = (data[0] == '-');
+    int start = (negative || data[0] == '+') ? 1 : 0;
+
+    // Numbers with up to nine digits always fit into an int
+    if (length - start > 9 ||
+        !parseDigits(data + start, length - start, mantissa, decimals) ||
+        decimals > 0)
+    {
+        return fallbackToInt(data, length);
+    }
+
+    return negative ? -(int) mantissa : (int) mantissa;
+}
+
+// The mantissa and the power of ten are both exact, so that the division is
+// rounded correctly, i.e. the result is the same double that a full string to
+// double conversion returns
+float FixedWidthParser::toFloat(const char* data, int length)
+{
+    quint64 mantissa;
+    int decimals;
+
+    if (!trim(data, length)) {
+        return 0.0F;
+    }
+
+    bool negative = (data[0] == '-');
+    int start = (negative || data[0] == '+') ? 1 : 0;
+
+    if (!parseDigits(data + start, length - start, mantissa, decimals)) {
+        return fallbackToFloat(data, length);
+    }
+
+    double value = (double) mantissa / powersOfTen[decimals];
+
+    return (float) (negative ? -value : value);
+}
+
+void FixedWidthParser::toIntColumn(
+    const char* first, qint64 stride, int count, int width, int* values
+)
+{
+    for (int i = 0; i < count; i++) {
+        values[i] = toInt(first + i * stride, width);
+    }
+}
+
+void FixedWidthParser::toFloatColumn(
+    const char* first, qint64 stride, int count, int width, float* values
+)
+{
+    for (int i = 0; i < count; i++) {
+        values[i] = toFloat(first + i * stride, width);
+    }
+}
+
+// Remove leading and trailing whitespace (as QByteArray::trimmed() does).
+// Return false if nothing is left.
+bool FixedWidthParser::trim(const char*& data, int& length)
+{
+    while (length > 0 && (data[0] == ' ' || (data[0] >= '\t' && data[0] <= '\r'))) {
+        data++;
+        length--;
+    }
+
+    while (length > 0 && (data[length - 1] == ' ' ||
+        (data[length - 1] >= '\t' && data[length - 1] <= '\r')))
+    {
+        length--;
+    }
+
+    return length > 0;
+}
+
+// Read digits with an optional decimal point into an integer mantissa and the
+// number of decimals. Return false for anything else (sign, exponent, digits
+// missing before or after the decimal point, too many digits), which is then
+// left to the full conversion
+bool FixedWidthParser::parseDigits(
+    const char* data, int length, quint64& mantissa, int& decimals
+)
+{
+    int digits = 0;
+    int point = -1;
+    int i = 0;
+
+    mantissa = 0;
+
+    while (i < length) {
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+        // Convert blocks of eight digits at once
+        if (length - i >= 8 && digits + 8 <= MAX_DIGITS) {
+
+            quint64 block;
+            memcpy(&block, data + i, 8);
+
+            if (isEightDigits(block)) {
+                mantissa = mantissa * 100000000 + eightDigitsToInt(block);
+                digits += 8;
+                i += 8;
+                continue;
+            }
+        }
+#endif
+
+        char c = data[i];
+
+        if (c >= '0' && c <= '9') {
+
+            if (++digits > MAX_DIGITS) {
+                return false;
+            }
+
+            mantissa = mantissa * 10 + (c - '0');
+        }
+        else if (c == '.' && point < 0 && digits > 0) {
+            point = digits;
+        }
+        else {
+            return false;
+        }
+
+        i++;
+    }
+
+    decimals = (point < 0) ? 0 : digits - point;
+
+    return digits > 0 && (point < 0 || decimals > 0);
+}
+
+// SWAR ("SIMD within a register"): test eight characters at once for being
+// digits
+bool FixedWidthParser::isEightDigits(quint64 block)
+{
+    return (
+        (block & 0xF0F0F0F0F0F0F0F0ULL) |
+        (((block + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)
+    ) == 0x3333333333333333ULL;
+}
+
+// SWAR: convert eight digits (first digit in the lowest byte) to an integer
+// with three multiplications instead of eight
+quint32 FixedWidthParser::eightDigitsToInt(quint64 block)
+{
+    const quint64 mask = 0x000000FF000000FFULL;
+    const quint64 mul1 = 100 + (1000000ULL << 32);
+    const quint64 mul2 = 1 + (10000ULL << 32);
+
+    block -= 0x3030303030303030ULL;
+    block = (block * 10) + (block >> 8);
+    block = (((block & mask) * mul1) + (((block >> 16) & mask) * mul2)) >> 32;
+
+    return (quint32) block;
+}
+
+int FixedWidthParser::fallbackToInt(const char* data, int length)
+{
+    return QByteArray(data, length).toInt();
+}
+
+float FixedWidthParser::fallbackToFloat(const char* data, int length)
+{
+    return QByteArray(data, length).toFloat();
+}
@@ -0,0 +1,37 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#ifndef FIXEDWIDTHPARSER_H
+#define FIXEDWIDTHPARSER_H
+
+#include <QtGlobal>
+
+// Conversion of the fixed width, right aligned ASCII numbers in dBase "N" and
+// "F" fields to int or float, without creating a QString. The results are the
+// same as those of QString::toInt() and QString::toFloat() on the trimmed
+// cell contents.
+class FixedWidthParser
+{
+public:
+    FixedWidthParser();
+    static int toInt(const char* data, int length);
+    static float toFloat(const char* data, int length);
+
+    // Convert the cells of one column. The first cell starts at first, the
+    // following cells are stride bytes apart (stride = record length)
+    static void toIntColumn(const char* first, qint64 stride, int count, int width, int* values);
+    static void toFloatColumn(const char* first, qint64 stride, int count, int width, float* values);
+
+private:
+    const static double powersOfTen[];
+    static bool trim(const char*& data, int& length);
+    static bool parseDigits(const char* data, int length, quint64& mantissa, int& decimals);
+    static bool isEightDigits(quint64 block);
+    static quint32 eightDigitsToInt(quint64 block);
+    static int fallbackToInt(const char* data, int length);
+    static float fallbackToFloat(const char* data, int length);
+};
+
+#endif // FIXEDWIDTHPARSER_H
@@ -1,12 +1,12 @@
 #include <QCommandLineParser>
 #include <QDateTime>
-#include <QDebug>
 #include <QDir>
 #include <QFileInfo>
 #include <QString>
 #include <QStringList>
 
 #include "helpers.h"
+#include "trace.h"
 
 Helpers::Helpers()
 {
@@ -74,7 +74,7 @@ bool Helpers::containsAll(QHash<QString, int> hash, QStringList keys)
 void Helpers::openFileOrAbort(QFile& file, QIODevice::OpenModeFlag mode)
 {
     if (!file.open(mode)) {
-        qDebug() << "Cannot open file: " << file.fileName() << ": " << file.errorString();
+        TRACE_ERROR("Cannot open file: " << file.fileName() << ": " << file.errorString());
         abort();
     }
 }
@@ -82,9 +82,9 @@ void Helpers::openFileOrAbort(QFile& file, QIODevice::OpenModeFlag mode)
 bool Helpers::filesAreIdentical(QString fileName_1, QString fileName_2, bool debug, int maxDiffs)
 {
     if (debug) {
-        qDebug() << "Comparing two files: ";
-        qDebug() << "File 1: " << fileName_1;
-        qDebug() << "File 2: " << fileName_2;
+        TRACE_INFO("Comparing two files: ");
+        TRACE_INFO("File 1: " << fileName_1);
+        TRACE_INFO("File 2: " << fileName_2);
     }
 
     QFile file_1(fileName_1);
@@ -110,10 +110,10 @@ bool Helpers::filesAreIdentical(QString fileName_1, QString fileName_2, bool deb
         while(i < blob_1.length() && n_diffs < maxDiffs) {
             if (blob_1[i] != blob_2[i]) {
                 n_diffs++;
-                qDebug() << QString("%1. byte difference at index %2").arg(
+                TRACE_INFO(QString("%1. byte difference at index %2").arg(
                     QString::number(n_diffs),
                     QString::number(i)
-                );
+                ));
             }
             i++;
         }
@@ -122,7 +122,7 @@ bool Helpers::filesAreIdentical(QString fileName_1, QString fileName_2, bool deb
     }
 
     if (debug) {
-        qDebug() << QString("The files %1 identical.").arg(result ? "are": "are not");
+        TRACE_INFO(QString("The files %1 identical.").arg(result ? "are": "are not"));
     }
 
     return result;
@@ -131,11 +131,11 @@ bool Helpers::filesAreIdentical(QString fileName_1, QString fileName_2, bool deb
 void Helpers::abortIfNoSuchFile(QString filePath, QString context)
 {
     if (!QFile::exists(filePath)) {
-        qDebug() << "File does not exist: " << filePath;
-        qDebug() << "Current directory: " << QDir::currentPath();
+        TRACE_ERROR("File does not exist: " << filePath);
+        TRACE_ERROR("Current directory: " << QDir::currentPath());
 
         if (!context.isEmpty()) {
-            qDebug() << context;
+            TRACE_ERROR(context);
         }
 
         abort();
@@ -151,13 +151,13 @@ bool Helpers::stringsAreEqual(QString* strings_1, QString* strings_2, int n, int
         if (*strings_1 != *strings_2) {
             n_diffs++;
             if (debug) {
-                qDebug() << QString(
+                TRACE_INFO(QString(
                     "%1. string mismatch at index %2:").arg(
                     QString::number(n_diffs),
                     QString::number(i)
-                );
-                qDebug() << QString("  string 1: '%1'").arg(*strings_1);
-                qDebug() << QString("  string 2: '%1'").arg(*strings_2);
+                ));
+                TRACE_INFO(QString("  string 1: '%1'").arg(*strings_1));
+                TRACE_INFO(QString("  string 2: '%1'").arg(*strings_2));
             }
         }
         strings_1++;
@@ -173,7 +173,7 @@ int Helpers::stringToInt(QString string, QString context, bool debug)
     int result = string.toInt();
 
     if (debug) {
-        qDebug() << context << result << QString("(= %1.toInt())").arg(singleQuote(string));
+        TRACE_DEBUG(context << result << QString("(= %1.toInt())").arg(singleQuote(string)));
     }
 
     return result;
@@ -184,7 +184,7 @@ float Helpers::stringToFloat(QString string, QString context, bool debug)
     float result = string.toFloat();
 
     if (debug) {
-        qDebug() << context << result << QString("(= %1.toFloat())").arg(singleQuote(string));
+        TRACE_DEBUG(context << result << QString("(= %1.toFloat())").arg(singleQuote(string)));
     }
 
     return result;
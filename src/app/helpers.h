@@ -28,6 +28,82 @@ public:
     static int index(float xi, const float *x, int n, float epsilon = 0.0001F);
     static float interpolate(float xi, const float *x, const float *y, int n);
     static QString removeFileExtension(QString);
+
+    // Number of elements of an array (known at compile time)
+    template <typename T, int n>
+    static constexpr int length(const T (&)[n])
+    {
+        return n;
+    }
+
+    // Are the elements of an array (from element i on) in ascending order?
+    template <int n>
+    static constexpr bool isSorted(const float (&x)[n], int i = 1)
+    {
+        return i >= n || (x[i - 1] <= x[i] && isSorted(x, i + 1));
+    }
+
+    // index() for an array x whose size is known at compile time and that is
+    // sorted in ascending order (check with isSorted()). Instead of searching
+    // the first element that xi does not exceed, it counts the elements that xi
+    // exceeds, which gives the same index without any branches.
+    template <int n>
+    static int index(float xi, const float (&x)[n], float epsilon = 0.0001F)
+    {
+        int count = 0;
+
+        for (int i = 0; i < n; i++) {
+            count += !(xi <= x[i] + epsilon);
+        }
+
+        return (count < n) ? count : n - 1;
+    }
+
+    // interpolate() for arrays x and y whose size is known at compile time and
+    // where x is sorted in ascending order (check with isSorted())
+    template <int n>
+    static float interpolate(float xi, const float (&x)[n], const float (&y)[n])
+    {
+        static_assert(n >= 2, "interpolate() needs at least two values");
+
+        int count = 0;
+
+        for (int i = 0; i < n; i++) {
+            count += !(xi <= x[i]);
+        }
+
+        int i = (count < 1) ? 1 : (count > n - 1) ? n - 1 : count;
+        float inner = (y[i - 1] + y[i]) / 2;
+
+        // count is n if xi is not a number, for which interpolate() returns 0
+        return (count == 0) ? y[0] :
+            (xi >= x[n - 1]) ? y[n - 1] :
+            (count == n) ? 0.0F :
+            inner;
+    }
+
+    // Same for the count values in xi, writing the results to result
+    template <int n>
+    static void index(
+        const float* xi, int count, const float (&x)[n], int* result,
+        float epsilon = 0.0001F
+    )
+    {
+        for (int k = 0; k < count; k++) {
+            result[k] = index(xi[k], x, epsilon);
+        }
+    }
+
+    template <int n>
+    static void interpolate(
+        const float* xi, int count, const float (&x)[n], const float (&y)[n],
+        float* result
+    )
+    {
+        for (int k = 0; k < count; k++) {
+            result[k] = interpolate(xi[k], x, y);
+        }
+    }
 };
 
 #endif // HELPERS_H
@@ -44,6 +44,7 @@ InitValues::InitValues():
     niedKorrF(1.09f),
     countSets(0)
 {
+    compileDistrictValues();
 }
 
 InitValues::~InitValues()
@@ -277,12 +278,15 @@ void InitValues::putToHash(QString bezirkeString, int value, int hashtyp) {
 
     if (hashtyp == 11) {
         putToHashL(bezirkeString, value, hashETP);
+        districtETP.compile(hashETP, defaultETP);
     }
     else if (hashtyp == 12) {
         putToHashL(bezirkeString, value, hashETPS);
+        districtETPS.compile(hashETPS, defaultETPS);
     }
     else if (hashtyp == 13) {
         putToHashL(bezirkeString, value, hashEG);
+        districtEG.compile(hashEG, defaultEG);
     }
 }
 
@@ -309,3 +313,67 @@ void InitValues::putToHashL(QString bezirkeString, int value, QHash<int, int> &h
         }
     }
 }
+
+void InitValues::compileDistrictValues()
+{
+    districtETP.compile(hashETP, defaultETP);
+    districtETPS.compile(hashETPS, defaultETPS);
+    districtEG.compile(hashEG, defaultEG);
+}
+
+DistrictValues::DistrictValues():
+    otherValue(0)
+{
+}
+
+void DistrictValues::compile(const QHash<int, int>& hash, int defaultValue)
+{
+    int maxBez = -1;
+
+    for (auto it = hash.constBegin(); it != hash.constEnd(); ++it) {
+        maxBez = qMax(maxBez, it.key());
+    }
+
+    otherValue = hash.contains(0) ? hash.value(0) : defaultValue;
+    entries.fill({otherValue, true}, qMin(maxBez, MAX_DENSE_DISTRICT) + 1);
+    largeDistricts.clear();
+
+    for (auto it = hash.constBegin(); it != hash.constEnd(); ++it) {
+        if (it.key() > MAX_DENSE_DISTRICT) {
+            largeDistricts[it.key()] = it.value();
+        }
+        else if (it.key() >= 0) {
+            entries[it.key()] = {it.value(), false};
+        }
+    }
+}
+
+// Value for the district bez, the value for district 0 or the default value
+int DistrictValues::get(int bez, bool& defaulted) const
+{
+    if (bez < 0 || bez >= entries.size()) {
+        defaulted = !largeDistricts.contains(bez);
+        return defaulted ? otherValue : largeDistricts.value(bez);
+    }
+
+    defaulted = entries[bez].defaulted;
+    return entries[bez].value;
+}
+
+// Is the value 0 for all districts?
+bool DistrictValues::isZero() const
+{
+    for (int i = 0; i < entries.size(); i++) {
+        if (entries[i].value != 0) {
+            return false;
+        }
+    }
+
+    for (int value : largeDistricts) {
+        if (value != 0) {
+            return false;
+        }
+    }
+
+    return otherValue == 0;
+}
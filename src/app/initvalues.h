@@ -8,6 +8,38 @@
 
 #include <QHash>
 #include <QString>
+#include <QVector>
+
+// Largest district that DistrictValues keeps in its array. Values of larger
+// districts are looked up in a hash.
+#define MAX_DENSE_DISTRICT 4095
+
+// Value of ETP, ETPS or EG per district (BEZIRK) in an array, compiled from
+// the "district -> value" hash read from config.xml. Districts without a value
+// get the value of district 0 or else the default value and are flagged as
+// defaulted.
+class DistrictValues
+{
+public:
+    DistrictValues();
+    void compile(const QHash<int, int>& hash, int defaultValue);
+    int get(int bez, bool& defaulted) const;
+    bool isZero() const;
+
+private:
+    struct Entry {
+        int value;
+        bool defaulted;
+    };
+
+    QVector<Entry> entries;
+
+    // values of the districts above MAX_DENSE_DISTRICT
+    QHash<int, int> largeDistricts;
+
+    // value of the districts without an entry
+    int otherValue;
+};
 
 class InitValues
 {
@@ -58,11 +90,19 @@ public:
     float getNiedKorrF();
     bool allSet();
     void putToHash(QString bezirkeString, int value, int hashtyp);
-    QHash<int, int> hashETP;
-    QHash<int, int> hashETPS;
-    QHash<int, int> hashEG;
+
+    // hashETP, hashETPS and hashEG, compiled again by each putToHash()
+    DistrictValues districtETP;
+    DistrictValues districtETPS;
+    DistrictValues districtEG;
+
     int getCountSets();
 
+    // Default values of the district parameters
+    const static int defaultEG = 775;
+    const static int defaultETP = 660;
+    const static int defaultETPS = 530;
+
 private:
     // Infiltrationsfaktoren
     float infdach, infbel1, infbel2, infbel3, infbel4;
@@ -81,6 +121,12 @@ private:
 
     int countSets;
 
+    // Value per district as read from config.xml
+    QHash<int, int> hashETP;
+    QHash<int, int> hashETPS;
+    QHash<int, int> hashEG;
+
+    void compileDistrictValues();
     void putToHashL(QString bezirkeString, int value, QHash<int, int> &hash);
 };
 
@@ -11,7 +11,6 @@
 #include <QString>
 #include <QStringList>
 #include <QTextStream>
-#include <QtDebug>
 
 #include "main.h"
 #include "bagrov.h"
@@ -21,6 +20,7 @@
 #include "helpers.h"
 #include "initvalues.h"
 #include "mainwindow.h"
+#include "trace.h"
 
 bool parseForBatch(int &argc, char** /*argv*/)
 {
@@ -32,7 +32,7 @@ bool parseForBatch(int &argc, char** /*argv*/)
 
     for (int i = 0; i < argc; i++) {
 
-        qDebug() << "Argument arg[" << i << "]: " << argv[i];
+        TRACE_DEBUG("Argument arg[" << i << "]: " << argv[i]);
 
         if (! qstrcmp(argv[i], "--batch"))
             isBatch = true;
@@ -78,9 +78,72 @@ void defineParser(QCommandLineParser* parser)
         QCoreApplication::translate("main", "Output table of Bagrov calculations")
     );
 
+    // Option -p --pipeline
+    QCommandLineOption pipelineOption(
+        QStringList() << "p" << "pipeline",
+        QCoreApplication::translate("main", "Read, calculate and write in parallel threads")
+    );
+
+    // Option -w --write-mode <collect|stream|mapped>
+    QCommandLineOption writeModeOption(
+        QStringList() << "w" << "write-mode",
+        QCoreApplication::translate("main", "Collect all results before writing (collect, default), write them while calculating (stream) or collect them and write them in parallel into the mapped file (mapped). In stream mode the numeric fields have a fixed width of 10 digits before the decimal point and CODE is as wide as in the input file, so that the field layout differs from the other modes"),
+        QCoreApplication::translate("main", "write-mode"),
+        "collect"
+    );
+
+    // Option -t --threads <N>
+    QCommandLineOption threadsOption(
+        QStringList() << "t" << "threads",
+        QCoreApplication::translate("main", "Calculate in N parallel threads"),
+        QCoreApplication::translate("main", "N"),
+        "1"
+    );
+
+    // Option -f --fast
+    QCommandLineOption fastOption(
+        QStringList() << "f" << "fast",
+        QCoreApplication::translate("main", "Calculate the surfaces with reordered arithmetic (results may differ in the last decimal)")
+    );
+
+    // Option -s --bagrov-solver <legacy|table|exact>
+    QCommandLineOption bagrovSolverOption(
+        QStringList() << "s" << "bagrov-solver",
+        QCoreApplication::translate("main", "Solve the Bagrov relation of unsealed surfaces approximately for each record (legacy, default), interpolate it in a precalculated table (table) or solve it exactly for each record (exact)"),
+        QCoreApplication::translate("main", "solver"),
+        "legacy"
+    );
+
+    // Option -u --usage-table <usage-table-file>
+    QCommandLineOption usageTableOption(
+        QStringList() << "u" << "usage-table",
+        QCoreApplication::translate("main", "Read the assignment of usage (NUTZUNG) and type (TYP) to usage, yield and irrigation from a text file instead of using the built-in one"),
+        QCoreApplication::translate("main", "usage-table-file")
+    );
+
+    // Option -a --all-records
+    QCommandLineOption allRecordsOption(
+        QStringList() << "a" << "all-records",
+        QCoreApplication::translate("main", "Calculate each record, also when an earlier record had the same input values except for code and area")
+    );
+
+    // Option -g --group-by-usage
+    QCommandLineOption groupByUsageOption(
+        QStringList() << "g" << "group-by-usage",
+        QCoreApplication::translate("main", "Group the records of each batch by usage and calculate each group with a kernel specialised for its usage")
+    );
+
     parser->addOption(debugOption);
     parser->addOption(configOption);
     parser->addOption(bagrovOption);
+    parser->addOption(pipelineOption);
+    parser->addOption(writeModeOption);
+    parser->addOption(threadsOption);
+    parser->addOption(fastOption);
+    parser->addOption(bagrovSolverOption);
+    parser->addOption(usageTableOption);
+    parser->addOption(allRecordsOption);
+    parser->addOption(groupByUsageOption);
 }
 
 void debugInputs(
@@ -91,12 +154,12 @@ void debugInputs(
     bool debug
 )
 {
-    qDebug() << "Running in batch mode...";
-    qDebug() << "inputFileName =" << inputFileName;
-    qDebug() << "outputFileName =" << outputFileName;
-    qDebug() << "configFile =" << configFileName;
-    qDebug() << "logFileName =" << logFileName;
-    qDebug() << "debug =" << debug;
+    TRACE_INFO("Running in batch mode...");
+    TRACE_INFO("inputFileName =" << inputFileName);
+    TRACE_INFO("outputFileName =" << outputFileName);
+    TRACE_INFO("configFile =" << configFileName);
+    TRACE_INFO("logFileName =" << logFileName);
+    TRACE_INFO("debug =" << debug);
 }
 
 // Options/arguments for example call on the command line
@@ -128,6 +191,51 @@ int main_batch(int argc, char *argv[])
     QString logFileName = Helpers::defaultLogFileName(outputFileName);
     bool debug = parser.isSet("debug");
 
+    if (debug) {
+        Trace::setLevel(TraceLevel::Debug);
+    }
+
+    // Check the values of the options before reading any data
+    bool threadsOk;
+    int threadCount = parser.value("threads").toInt(&threadsOk);
+
+    if (!threadsOk || threadCount < 1) {
+        TRACE_ERROR("Ungueltige Anzahl Threads: " << parser.value("threads"));
+        return 2;
+    }
+
+    BagrovSolver bagrovSolver;
+
+    if (parser.value("bagrov-solver") == "legacy") {
+        bagrovSolver = BagrovSolver::Legacy;
+    }
+    else if (parser.value("bagrov-solver") == "table") {
+        bagrovSolver = BagrovSolver::Table;
+    }
+    else if (parser.value("bagrov-solver") == "exact") {
+        bagrovSolver = BagrovSolver::Exact;
+    }
+    else {
+        TRACE_ERROR("Unbekannter Bagrov-Loeser: " << parser.value("bagrov-solver"));
+        return 2;
+    }
+
+    WriteMode writeMode;
+
+    if (parser.value("write-mode") == "collect") {
+        writeMode = WriteMode::Collect;
+    }
+    else if (parser.value("write-mode") == "stream") {
+        writeMode = WriteMode::Stream;
+    }
+    else if (parser.value("write-mode") == "mapped") {
+        writeMode = WriteMode::Mapped;
+    }
+    else {
+        TRACE_ERROR("Unbekannter Schreibmodus: " << parser.value("write-mode"));
+        return 2;
+    }
+
     // Handle --write_bagrov-table
     if (parser.isSet("write-bagrov-table")) {
         writeBagrovTable();
@@ -136,10 +244,12 @@ int main_batch(int argc, char *argv[])
 
     debugInputs(inputFileName, outputFileName, configFileName, logFileName, debug);
 
-    DbaseReader dbReader(inputFileName);
+    // Only read the header here. The records are read chunk by chunk during
+    // the calculation
+    DbaseReader dbReader(inputFileName, ReadMode::Streamed);
 
     if (! dbReader.checkAndRead()) {
-        qDebug() << dbReader.getFullError();
+        TRACE_ERROR(dbReader.getFullError());
         return 2;
     }
 
@@ -148,14 +258,16 @@ int main_batch(int argc, char *argv[])
     QString errorMessage = InitValues::updateFromConfig(initValues, configFileName);
 
     if (errorMessage.length() > 0) {
-        qDebug() << "Error: " << errorMessage;
+        TRACE_ERROR("Error: " << errorMessage);
     }
 
     QFile logFile(logFileName);
 
     if (! logFile.open(QFile::WriteOnly)) {
-        qDebug() << "Konnte Datei: '" << logFileName <<
-            "' nicht oeffnen.\n" << logFile.error();
+        TRACE_ERROR(
+            "Konnte Datei: '" << logFileName << "' nicht oeffnen.\n" <<
+            logFile.error()
+        );
         return 1;
     }
 
@@ -165,12 +277,28 @@ int main_batch(int argc, char *argv[])
 
     // Create calculator object
     Calculation calculator(dbReader, initValues, logStream);
+    calculator.setPipelined(parser.isSet("pipeline"));
+    calculator.setThreadCount(threadCount);
+    calculator.setStrict(!parser.isSet("fast"));
+    calculator.setDeduplicate(!parser.isSet("all-records"));
+    calculator.setPartitioned(parser.isSet("group-by-usage"));
+    calculator.setBagrovSolver(bagrovSolver);
+    calculator.setWriteMode(writeMode);
+
+    if (parser.isSet("usage-table")) {
+        calculator.setUsageTableFile(parser.value("usage-table"));
+    }
+
+    TRACE_INFO("Start the calculation");
+
+    if (!calculator.calc(outputFileName)) {
+        TRACE_ERROR("Error: " << calculator.getError());
+        return 1;
+    }
 
-    qDebug() << "Start the calculation";
-    calculator.calc(outputFileName);
-    qDebug() << "End of calculation (Results are in " << outputFileName << ").";
+    TRACE_INFO("End of calculation (Results are in " << outputFileName << ").");
 
-    return -1;
+    return 0;
 }
 
 int main_gui(int argc, char *argv[])
@@ -197,7 +325,7 @@ int main(int argc, char *argv[])
 
     //return 0;
 
-    qDebug() << "Number of command line arguments: " << argc;
+    TRACE_INFO("Number of command line arguments: " << argc);
 
     if (parseForBatch(argc, argv)) {
 
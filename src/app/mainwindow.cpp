@@ -10,6 +10,7 @@
 #include <QFont>
 #include <QFile>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QLabel>
 #include <QMainWindow>
 #include <QMenuBar>
@@ -17,6 +18,7 @@
 #include <QProgressDialog>
 #include <QString>
 #include <QTextStream>
+#include <QThread>
 #include <QWidget>
 
 #include "calculation.h"
@@ -33,13 +35,24 @@ MainWindow::MainWindow(QApplication* app, QCommandLineParser* arguments):
     calc(0),
     app(app),
     arguments(arguments),
-    folder("/")
+    folder("/"),
+    threadCount(1)
 {
+    // Number of calculating threads, as long as not changed in the menu
+    if (arguments != NULL) {
+        threadCount = qMax(1, arguments->value("threads").toInt());
+    }
+
     // Define action: Compute File
     openAct = new QAction(tr("&Compute File"), this);
     openAct->setShortcut(tr("Ctrl+C"));
     connect(openAct, SIGNAL(triggered()), this, SLOT(computeFile()));
 
+    // Define action: Threads
+    threadsAct = new QAction(tr("&Threads"), this);
+    threadsAct->setShortcut(tr("Ctrl+T"));
+    connect(threadsAct, SIGNAL(triggered()), this, SLOT(selectThreadCount()));
+
     // Define action: About
     aboutAct = new QAction(tr("&About"), this);
     aboutAct->setShortcut(tr("Ctrl+A"));
@@ -47,6 +60,7 @@ MainWindow::MainWindow(QApplication* app, QCommandLineParser* arguments):
 
     // Add actions to the menu bar
     menuBar()->addAction(openAct);
+    menuBar()->addAction(threadsAct);
     menuBar()->addAction(aboutAct);
 
     // Set window title and size
@@ -72,6 +86,7 @@ MainWindow::~MainWindow()
     delete textfield;
     delete openAct;
     delete aboutAct;
+    delete threadsAct;
     delete progress;
     delete widget;
 }
@@ -95,6 +110,26 @@ void MainWindow::userCancel()
     app->processEvents(QEventLoop::ExcludeUserInputEvents);
 }
 
+void MainWindow::selectThreadCount()
+{
+    bool ok;
+
+    int count = QInputDialog::getInt(
+        this,
+        programName,
+        "Anzahl paralleler Threads fuer die Berechnung:",
+        threadCount,
+        1,
+        qMax(threadCount, QThread::idealThreadCount()),
+        1,
+        &ok
+    );
+
+    if (ok) {
+        threadCount = count;
+    }
+}
+
 void MainWindow::about()
 {
     QMessageBox::about(
@@ -204,6 +239,7 @@ void MainWindow::computeFile()
 
     // Create calculator object
     calc = new Calculation(dbReader, initValues, protokollStream);
+    calc->setThreadCount(threadCount);
 
     connect(
         calc,
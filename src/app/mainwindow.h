@@ -33,6 +33,7 @@ private slots:
     void processEvent(int, QString);
     void about();
     void computeFile();
+    void selectThreadCount();
     void userCancel();
 
 private:
@@ -44,6 +45,7 @@ private:
     void reportCancelled(QTextStream&);
     QAction *openAct;
     QAction *aboutAct;
+    QAction *threadsAct;
     QLabel *textfield;
     QProgressDialog * progress;
     bool userStop;
@@ -51,6 +53,7 @@ private:
     QApplication* app;
     QCommandLineParser* arguments;
     QString folder;
+    int threadCount;
     QWidget *widget;
 };
 
@@ -3,9 +3,8 @@
  * of this repository (https://github.com/KWB-R/abimo).
  ***************************************************************************/
 
-#include <QDebug>
-
 #include "saxhandler.h"
+#include "trace.h"
 
 SaxHandler::SaxHandler(InitValues &initValues):
     state(ParameterGroup::None),
@@ -56,11 +55,11 @@ bool SaxHandler::startElement(
             break;
 
         case ParameterGroup::None:
-            qDebug() << "state is still 'None'";
+            TRACE_WARNING("state is still 'None'");
             return false;
 
         case ParameterGroup::Invalid:
-            qDebug() << "state is 'Invalid'";
+            TRACE_WARNING("state is 'Invalid'");
             return false;
         }
     }
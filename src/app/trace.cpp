@@ -0,0 +1,19 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#include "trace.h"
+
+// Debug messages only when asked for (e.g. option --debug)
+QAtomicInt Trace::currentLevel((int) TraceLevel::Info);
+
+TraceLevel Trace::getLevel()
+{
+    return (TraceLevel) currentLevel.loadRelaxed();
+}
+
+void Trace::setLevel(TraceLevel level)
+{
+    currentLevel.storeRelaxed((int) level);
+}
@@ -0,0 +1,81 @@
+/***************************************************************************
+ * For copyright information please see COPYRIGHT in the base directory
+ * of this repository (https://github.com/KWB-R/abimo).
+ ***************************************************************************/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QAtomicInt>
+#include <QtDebug>
+
+// Highest level of the trace points that are compiled at all (0 to 4, see
+// TraceLevel). Trace points of a higher level are removed by the
+// preprocessor (qmake CONFIG+=notrace: only errors, see common.pri).
+#ifndef TRACE_MAX_LEVEL
+#define TRACE_MAX_LEVEL 4
+#endif
+
+enum struct TraceLevel {
+    None = 0,
+    Error = 1,
+    Warning = 2,
+    Info = 3,
+    // e.g. the conversion of each input value
+    Debug = 4
+};
+
+// Level of the messages that are written (with qDebug()). The level is the
+// same for all threads and may be changed at any time.
+class Trace
+{
+public:
+    static TraceLevel getLevel();
+    static void setLevel(TraceLevel level);
+    static bool isEnabled(TraceLevel level);
+
+private:
+    static QAtomicInt currentLevel;
+};
+
+inline bool Trace::isEnabled(TraceLevel level)
+{
+    return (int) level <= TRACE_MAX_LEVEL &&
+        (int) level <= currentLevel.loadRelaxed();
+}
+
+// Trace point: writes the arguments, streamed into qDebug(), if the level is
+// enabled. The arguments are only evaluated then, e.g.
+// TRACE_DEBUG("k:" << k << QString("(= %1)").arg(value))
+#define TRACE(level, ...) \
+    do { \
+        if (Trace::isEnabled(level)) { \
+            qDebug() << __VA_ARGS__; \
+        } \
+    } while (0)
+
+#if TRACE_MAX_LEVEL >= 1
+#define TRACE_ERROR(...) TRACE(TraceLevel::Error, __VA_ARGS__)
+#else
+#define TRACE_ERROR(...) do {} while (0)
+#endif
+
+#if TRACE_MAX_LEVEL >= 2
+#define TRACE_WARNING(...) TRACE(TraceLevel::Warning, __VA_ARGS__)
+#else
+#define TRACE_WARNING(...) do {} while (0)
+#endif
+
+#if TRACE_MAX_LEVEL >= 3
+#define TRACE_INFO(...) TRACE(TraceLevel::Info, __VA_ARGS__)
+#else
+#define TRACE_INFO(...) do {} while (0)
+#endif
+
+#if TRACE_MAX_LEVEL >= 4
+#define TRACE_DEBUG(...) TRACE(TraceLevel::Debug, __VA_ARGS__)
+#else
+#define TRACE_DEBUG(...) do {} while (0)
+#endif
+
+#endif // TRACE_H
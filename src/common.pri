@@ -1 +1,19 @@
 #DEFINES += QT_NO_DEBUG_OUTPUT
+
+# The batch kernel (calculationKernel.cpp) is written to be vectorised by the
+# compiler. Fused multiply-adds would change its results, so they stay off.
+*-g++*|*-clang* {
+    QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize -ffp-contract=off
+}
+
+# qmake CONFIG+=notrace: only compile the trace points for errors (see
+# app/trace.h)
+notrace {
+    DEFINES += TRACE_MAX_LEVEL=1
+}
+
+# qmake CONFIG+=avx2: wider vectors for machines that support AVX2
+avx2 {
+    msvc: QMAKE_CXXFLAGS += -arch:AVX2
+    else: QMAKE_CXXFLAGS += -mavx2
+}
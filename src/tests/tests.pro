@@ -26,27 +26,38 @@ INCDIR = ../app
 
 HEADERS += \
     $$INCDIR/bagrov.h \
+    $$INCDIR/bagrovTable.h \
+    $$INCDIR/boundedQueue.h \
     $$INCDIR/calculation.h\
+    $$INCDIR/calculationKernel.h\
     $$INCDIR/config.h\
     $$INCDIR/dbaseField.h \
     $$INCDIR/dbaseReader.h \
     $$INCDIR/dbaseWriter.h \
     $$INCDIR/effectivenessunsealed.h \
+    $$INCDIR/fixedWidthEncoder.h \
+    $$INCDIR/fixedWidthParser.h \
     $$INCDIR/helpers.h \
     $$INCDIR/initvalues.h \
     $$INCDIR/pdr.h \
-    $$INCDIR/saxhandler.h
+    $$INCDIR/saxhandler.h \
+    $$INCDIR/trace.h
 
 SOURCES += \
     $$INCDIR/bagrov.cpp \
+    $$INCDIR/bagrovTable.cpp \
     $$INCDIR/calculation.cpp \
+    $$INCDIR/calculationKernel.cpp \
     $$INCDIR/config.cpp \
     $$INCDIR/dbaseField.cpp \
     $$INCDIR/dbaseReader.cpp \
     $$INCDIR/dbaseWriter.cpp \
     $$INCDIR/effectivenessunsealed.cpp \
+    $$INCDIR/fixedWidthEncoder.cpp \
+    $$INCDIR/fixedWidthParser.cpp \
     $$INCDIR/helpers.cpp \
     $$INCDIR/initvalues.cpp \
     $$INCDIR/pdr.cpp \
     $$INCDIR/saxhandler.cpp \
+    $$INCDIR/trace.cpp \
     tst_testabimo.cpp
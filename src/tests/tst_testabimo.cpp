@@ -1,15 +1,28 @@
+#include <limits.h>
+#include <math.h>
+#include <string.h>
 #include <QDir>
 #include <QFile>
+#include <QPair>
+#include <QSet>
 #include <QtDebug>
 #include <QtGlobal>
 #include <QString>
 #include <QStringList>
 #include <QtTest>
+#include <QVector>
 
+#include "../app/bagrov.h"
+#include "../app/bagrovTable.h"
 #include "../app/calculation.h"
+#include "../app/calculationKernel.h"
 #include "../app/config.h"
 #include "../app/dbaseReader.h"
+#include "../app/effectivenessunsealed.h"
+#include "../app/fixedWidthEncoder.h"
+#include "../app/fixedWidthParser.h"
 #include "../app/helpers.h"
+#include "../app/trace.h"
 
 class TestAbimo : public QObject
 {
@@ -23,17 +36,32 @@ private slots:
     void test_helpers_containsAll();
     void test_helpers_filesAreIdentical();
     void test_helpers_stringsAreEqual();
+    void test_helpers_sortedLookup();
+    void test_trace();
     void test_requiredFields();
     void test_dbaseReader();
+    void test_fixedWidthParser();
+    void test_fixedWidthEncoder();
     void test_xmlReader();
     void test_config_getTWS();
+    void test_config_usageTable();
+    void test_effectivenessTable();
+    void test_districtValues();
+    void test_climateCache();
+    void test_recordCache();
+    void test_partitionedKernel();
+    void test_kernelPolicy();
     void test_calc();
     void test_bagrov();
+    void test_bagrovTable();
+    void benchmark_bagrovCalls_data();
+    void benchmark_bagrovCalls();
 
     QString testDataDir();
     QString dataFilePath(QString fileName, bool mustExist = true);
     bool dbfHeadersAreIdentical(QString file_1, QString file_2);
     bool dbfStringsAreIdentical(QString file_1, QString file_2);
+    bool dbfValuesAreEqual(QString file_1, QString file_2);
     bool numbersInFilesDiffer(QString file_1, QString file_2, int n_1, int n_2, QString subject);
 };
 
@@ -92,6 +120,67 @@ void TestAbimo::test_helpers_stringsAreEqual()
     QCOMPARE(Helpers::stringsAreEqual(strings_1, strings_2, 6), false);
 }
 
+void TestAbimo::test_helpers_sortedLookup()
+{
+    const float x[] = {0.1F, 0.2F, 0.4F, 0.8F};
+    const float y[] = {1.0F, 2.0F, 3.0F, 4.0F};
+    const float xi[] = {
+        -1.0F, 0.1F, 0.10005F, 0.15F, 0.2F, 0.3F, 0.8F, 0.9F, NAN, INFINITY
+    };
+
+    const float unsorted[] = {0.1F, 0.4F, 0.2F};
+
+    QVERIFY(Helpers::isSorted(x));
+    QVERIFY(!Helpers::isSorted(unsorted));
+    QCOMPARE(Helpers::length(xi), 10);
+
+    int indices[10];
+    float values[10];
+
+    Helpers::index(xi, 10, x, indices);
+    Helpers::interpolate(xi, 10, x, y, values);
+
+    // Same results as the linear search in the unsized versions
+    for (int k = 0; k < 10; k++) {
+        QCOMPARE(indices[k], Helpers::index(xi[k], x, 4));
+        QCOMPARE(values[k], Helpers::interpolate(xi[k], x, y, 4));
+    }
+
+    QCOMPARE(Helpers::index(0.3F, x), 2);
+    QCOMPARE(Helpers::interpolate(0.3F, x, y), 2.5F);
+    QCOMPARE(Helpers::interpolate(0.9F, x, y), 4.0F);
+}
+
+// Counts the calls, to see whether the arguments of a trace point were evaluated
+static int countCall(int& calls)
+{
+    return ++calls;
+}
+
+void TestAbimo::test_trace()
+{
+    TraceLevel level = Trace::getLevel();
+    int calls = 0;
+
+    Trace::setLevel(TraceLevel::Info);
+    QVERIFY(Trace::isEnabled(TraceLevel::Error));
+    QVERIFY(Trace::isEnabled(TraceLevel::Info));
+    QVERIFY(!Trace::isEnabled(TraceLevel::Debug));
+
+    // The arguments are only evaluated if the level is enabled
+    TRACE_DEBUG("not written" << countCall(calls));
+    QCOMPARE(calls, 0);
+
+    TRACE_INFO("written" << countCall(calls));
+    QCOMPARE(calls, TRACE_MAX_LEVEL >= 3 ? 1 : 0);
+
+    Trace::setLevel(TraceLevel::None);
+    TRACE_ERROR("not written" << countCall(calls));
+    QCOMPARE(calls, TRACE_MAX_LEVEL >= 3 ? 1 : 0);
+
+    Trace::setLevel(level);
+}
+
 void TestAbimo::test_requiredFields()
 {
     QStringList strings = DbaseReader::requiredFields();
@@ -108,6 +197,113 @@ void TestAbimo::test_dbaseReader()
 
     QCOMPARE(success, true);
     QCOMPARE(reader.isAbimoFile(), true);
+
+    // A header whose field (10 bytes) does not fit into the records (5 bytes
+    // with the deletion flag) is rejected in each mode
+    QByteArray bytes(32, '\0');
+    bytes[0] = 0x03;
+    bytes[4] = 1;
+    bytes[8] = 65;
+    bytes[10] = 5;
+
+    QByteArray field(32, '\0');
+    field.replace(0, 4, "CODE");
+    field[11] = 'C';
+    field[16] = 10;
+
+    bytes += field;
+    bytes += '\x0D';
+    bytes += " abcd";
+    bytes += '\x1A';
+
+    QString fileName = QDir::temp().filePath("abimo_bad_header.dbf");
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(bytes);
+    file.close();
+
+    ReadMode modes[] = {ReadMode::Copy, ReadMode::Mapped, ReadMode::Streamed};
+
+    for (ReadMode mode : modes) {
+        DbaseReader badReader(fileName, mode);
+        QCOMPARE(badReader.read(), false);
+        QVERIFY(badReader.getError().startsWith("Felder laenger als die Records"));
+    }
+
+    file.remove();
+}
+
+void TestAbimo::test_fixedWidthParser()
+{
+    QStringList cells = {
+        "   12", "-5", "+3", "  0", "", "    ", "12.50", " 1.5 ", "0012.3400",
+        "-0.000", "12345678", "123456789012", "1e3", "5.", ".5", "1.2.3",
+        "99999999999999.9", "1234567890123456", "0.1", "3.171", "-1234.567"
+    };
+
+    for (int i = 0; i < cells.length(); i++) {
+
+        QByteArray bytes = cells.at(i).toLatin1();
+        QString trimmed = cells.at(i).trimmed();
+
+        QCOMPARE(
+            FixedWidthParser::toInt(bytes.constData(), bytes.length()),
+            trimmed.toInt()
+        );
+
+        // The float results must be identical, not only close to each other
+        QCOMPARE(
+            qFloatDistance(
+                FixedWidthParser::toFloat(bytes.constData(), bytes.length()),
+                trimmed.toFloat()
+            ),
+            (quint32) 0
+        );
+    }
+}
+
+void TestAbimo::test_fixedWidthEncoder()
+{
+    QList<float> values = {
+        0.0F, -0.0F, 0.004F, -0.004F, 0.005F, -0.005F, 0.125F, -2.5F, 1.005F,
+        99.995F, 123.456F, -9876.54321F, 3.171F, 1e9F, 1.5e10F, -1e-30F
+    };
+
+    char cell[64];
+
+    for (int i = 0; i < values.length(); i++) {
+        for (int decimalCount = 0; decimalCount < 5; decimalCount++) {
+
+            // What DbaseWriter did before writing the bytes directly
+            float value = values.at(i);
+            value *= pow(10, decimalCount);
+            value = round(value);
+            value *= pow(10, -decimalCount);
+
+            QString expected;
+            expected.setNum(value, 'f', decimalCount);
+
+            int length = FixedWidthEncoder::numberLength(values.at(i), decimalCount);
+            QCOMPARE(length, expected.size());
+
+            QVERIFY(FixedWidthEncoder::encodeNumber(cell, length, values.at(i), decimalCount));
+            QCOMPARE(QByteArray(cell, length), expected.toLatin1());
+
+            // Filled up with zeros, behind the sign if there are decimals
+            QVERIFY(FixedWidthEncoder::encodeNumber(cell, length + 2, values.at(i), decimalCount));
+            QCOMPARE(
+                QByteArray(cell, length + 2),
+                (decimalCount > 0 && expected.startsWith('-')) ?
+                    expected.replace(0, 1, "-00").toLatin1() :
+                    expected.rightJustified(length + 2, '0').toLatin1()
+            );
+
+            QVERIFY(!FixedWidthEncoder::encodeNumber(cell, length - 1, values.at(i), decimalCount));
+        }
+    }
+
+    QVERIFY(FixedWidthEncoder::encodeString(cell, 6, "a12"));
+    QCOMPARE(QByteArray(cell, 6), QByteArray("000a12"));
 }
 
 void TestAbimo::test_xmlReader()
@@ -145,6 +341,359 @@ void TestAbimo::test_config_getTWS()
     QVERIFY(qFuzzyCompare(config.getTWS(50, Usage::unknown), 0.2F));
 }
 
+void TestAbimo::test_config_usageTable()
+{
+    Config config;
+
+    // Type defined for the usage, type taken from the default type 72, usage
+    // independent of type, undefined usage
+    QCOMPARE((int) config.getUsageEntry(10, 24).tupleIndex, 13);
+    QCOMPARE(config.getUsageEntry(10, 24).typeDefaulted, false);
+    QCOMPARE((int) config.getUsageEntry(10, 500).tupleIndex, 10);
+    QCOMPARE(config.getUsageEntry(10, 500).typeDefaulted, true);
+    QCOMPARE((int) config.getUsageEntry(10, 500).defaultType, 72);
+    QCOMPARE((int) config.getUsageEntry(60, 3).tupleIndex, 8);
+    QCOMPARE((int) config.getUsageEntry(15, 3).tupleIndex, -1);
+    QCOMPARE((int) config.getUsageEntry(1000, 3).tupleIndex, -1);
+
+    QCOMPARE(config.getUsageResult(10, 500, "X").message, QString(
+        "\r\nNutzungstyp nicht definiert fuer Element X\r\nTyp=72 angenommen\r\n"
+    ));
+
+    QString fileName = QDir::temp().filePath("abimo_usage_table.csv");
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write(
+        "# test table\n"
+        "tuple,0,L,50,0\n"
+        "tuple,1,W,0,0\n"
+        "type,300,1,1\n"
+        "type,300,2,0\n"
+        "default,300,2\n"
+        "type,301,*,1\n"
+    );
+    file.close();
+
+    QCOMPARE(config.load(fileName), QString());
+    QCOMPARE((int) config.getUsageEntry(300, 1).tupleIndex, 1);
+    QCOMPARE((int) config.getUsageEntry(300, 7).tupleIndex, 0);
+    QCOMPARE(config.getUsageEntry(300, 7).typeDefaulted, true);
+    QCOMPARE((int) config.getUsageEntry(301, 7).tupleIndex, 1);
+    QCOMPARE((int) config.getUsageEntry(10, 24).tupleIndex, -1);
+    QVERIFY(config.getUsageTuple(1).usage == Usage::forested_W);
+
+    // A type assigned to an undefined tuple is an error, the table is kept
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write("tuple,0,L,50,0\ntype,302,1,1\n");
+    file.close();
+
+    QVERIFY(!config.load(fileName).isEmpty());
+    QCOMPARE((int) config.getUsageEntry(300, 1).tupleIndex, 1);
+
+    // Default type without a "type" line, usage without default and without
+    // '*', no tuples at all: errors naming the line where there is one
+    QString prefix = Helpers::singleQuote(fileName) + ": ";
+
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write("tuple,0,L,50,0\ntype,302,1,0\ndefault,302,2\n");
+    file.close();
+
+    QCOMPARE(config.load(fileName), prefix +
+        "Zeile 3: Typ 2 der Nutzung 302 nicht definiert.");
+
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write("tuple,0,L,50,0\ntype,301,*,0\n\ntype,302,1,0\ntype,302,2,0\n");
+    file.close();
+
+    QCOMPARE(config.load(fileName), prefix +
+        "Zeile 4: Nutzung 302 ohne default und ohne Typ *.");
+
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write("# no tuples\n");
+    file.close();
+
+    QCOMPARE(config.load(fileName), prefix + "Keine Tupel definiert.");
+    QCOMPARE((int) config.getUsageEntry(300, 1).tupleIndex, 1);
+
+    file.remove();
+}
+
+void TestAbimo::test_effectivenessTable()
+{
+    Config config;
+    EffectivenessTable table;
+    PDR record;
+    float value;
+
+    table.build(config, false);
+
+    for (int t = 0; t < config.getUsageTupleCount(); t++) {
+
+        record.setUsageYieldIrrigation(config.getUsageTuple(t));
+        record.P1S = 0;
+        record.ETPS = 0;
+
+        for (int nFK = 0; nFK < EffectivenessUnsealed::nFKCount; nFK++) {
+            record.nFK = nFK;
+            QVERIFY(table.lookup(t, nFK, true, value));
+            QCOMPARE(value, EffectivenessUnsealed::getNUV(record));
+        }
+    }
+
+    // Outside the table
+    QVERIFY(!table.lookup(0, EffectivenessUnsealed::nFKCount, true, value));
+    QVERIFY(!table.lookup(config.getUsageTupleCount(), 0, true, value));
+}
+
+void TestAbimo::test_districtValues()
+{
+    QHash<int, int> hash;
+    DistrictValues values;
+    bool defaulted;
+
+    hash[1] = 600;
+    values.compile(hash, 660);
+
+    QCOMPARE(values.get(1, defaulted), 600);
+    QCOMPARE(defaulted, false);
+
+    // No value for the district and no value for district 0
+    QCOMPARE(values.get(2, defaulted), 660);
+    QCOMPARE(defaulted, true);
+
+    // The value for district 0 is the default, also beyond the array
+    hash[0] = 650;
+    values.compile(hash, 660);
+
+    QCOMPARE(values.get(2, defaulted), 650);
+    QCOMPARE(defaulted, true);
+    QCOMPARE(values.get(1000, defaulted), 650);
+    QCOMPARE(defaulted, true);
+    QCOMPARE(values.get(0, defaulted), 650);
+    QCOMPARE(defaulted, false);
+    QCOMPARE(values.isZero(), false);
+
+    // 0 for all districts, also for those without a value
+    hash.clear();
+    hash[0] = 0;
+    hash[3] = 0;
+    values.compile(hash, 660);
+
+    QCOMPARE(values.isZero(), true);
+
+    hash[2] = 1;
+    values.compile(hash, 0);
+
+    QCOMPARE(values.isZero(), false);
+
+    // Districts beyond the array, up to the largest int
+    hash.clear();
+    hash[0] = 650;
+    hash[5000000] = 700;
+    hash[INT_MAX] = 710;
+    values.compile(hash, 660);
+
+    QCOMPARE(values.get(5000000, defaulted), 700);
+    QCOMPARE(defaulted, false);
+    QCOMPARE(values.get(INT_MAX, defaulted), 710);
+    QCOMPARE(defaulted, false);
+    QCOMPARE(values.get(4999999, defaulted), 650);
+    QCOMPARE(defaulted, true);
+
+    hash.clear();
+    hash[0] = 0;
+    hash[MAX_DENSE_DISTRICT + 1] = 0;
+    values.compile(hash, 660);
+
+    QCOMPARE(values.isZero(), true);
+
+    hash[MAX_DENSE_DISTRICT + 2] = 1;
+    values.compile(hash, 660);
+
+    QCOMPARE(values.isZero(), false);
+
+    // The values of InitValues follow each change of its hashes
+    InitValues initValues;
+
+    QCOMPARE(initValues.districtETP.get(3, defaulted), (int) InitValues::defaultETP);
+    QCOMPARE(defaulted, true);
+
+    initValues.putToHash("2-4", 700, 11);
+
+    QCOMPARE(initValues.districtETP.get(3, defaulted), 700);
+    QCOMPARE(defaulted, false);
+    QCOMPARE(initValues.districtETPS.get(3, defaulted), (int) InitValues::defaultETPS);
+    QCOMPARE(defaulted, true);
+}
+
+void TestAbimo::test_climateCache()
+{
+    ClimateCache cache;
+    SealedRunoffs runoffs = {1.0F, {2.0F, 3.0F, 4.0F, 5.0F}};
+    SealedRunoffs found;
+
+    QCOMPARE(cache.lookup(600, 660, found), false);
+
+    cache.insert(600, 660, runoffs);
+
+    QCOMPARE(cache.lookup(600, 660, found), true);
+    QCOMPARE(found.RDV, 1.0F);
+    QCOMPARE(found.RV[3], 5.0F);
+
+    // Other precipitation or other evaporation
+    QCOMPARE(cache.lookup(601, 660, found), false);
+    QCOMPARE(cache.lookup(600, 661, found), false);
+}
+
+void TestAbimo::test_recordCache()
+{
+    DbaseReader reader(dataFilePath("abimo_2019_mitstrassen.dbf"), ReadMode::Streamed);
+    QVERIFY(reader.checkAndRead());
+
+    abimoColumns input;
+    int count = reader.nextChunk(input, 1024);
+    QVERIFY(count > 0);
+
+    // Same records with twice the areas: same shares of the areas
+    abimoColumns scaled = input;
+
+    for (int i = 0; i < count; i++) {
+        scaled.FLGES[i] *= 2;
+        scaled.STR_FLGES[i] *= 2;
+    }
+
+    InitValues initValues;
+    KernelParameters parameters(initValues);
+    ClimateCache climateCache;
+    RecordCache cache;
+
+    for (int i = 0; i < count; i++) {
+
+        // The decision about defaulting the area may change with the area
+        if (input.FLGES.at(i) + input.STR_FLGES.at(i) < 0.001F) {
+            continue;
+        }
+
+        RecordKey key = CalculationKernel::getKey(input, i, parameters);
+        QVERIFY(CalculationKernel::getKey(scaled, i, parameters) == key);
+
+        KernelBatch batch;
+        RecordResult result;
+
+        if (!cache.lookup(key, result)) {
+            CalculationKernel::calculateBatch(input, i, 1, parameters, climateCache, batch);
+            cache.insert(key, CalculationKernel::getResult(batch, 0));
+            QVERIFY(cache.lookup(key, result));
+        }
+
+        // The cached results give exactly the results of the scaled record
+        CalculationKernel::calculateBatch(scaled, i, 1, parameters, climateCache, batch);
+        QCOMPARE(result.flags, batch.flags[0]);
+
+        if (CalculationKernel::isCalculated(result.flags)) {
+
+            abimoOutputRecord expected;
+            abimoOutputRecord record;
+
+            CalculationKernel::getRecord(scaled, i, 0, batch, expected);
+            CalculationKernel::getRecord(scaled, i, result, parameters, record);
+
+            // all float fields from R to VERDUNSTUN, bit by bit
+            QCOMPARE(record.CODE, expected.CODE);
+            QVERIFY(memcmp(&record.R, &expected.R, 8 * sizeof(float)) == 0);
+        }
+    }
+}
+
+void TestAbimo::test_partitionedKernel()
+{
+    DbaseReader reader(dataFilePath("abimo_2019_mitstrassen.dbf"), ReadMode::Streamed);
+    QVERIFY(reader.checkAndRead());
+
+    abimoColumns input;
+    int count = reader.nextChunk(input, 1024);
+    QVERIFY(count > 0);
+
+    InitValues initValues;
+    KernelParameters parameters(initValues);
+    KernelParameters partitioned(initValues);
+    partitioned.partitioned = true;
+
+    ClimateCache cache;
+    ClimateCache partitionedCache;
+
+    for (int first = 0; first < count; first += KERNEL_BATCH_SIZE) {
+
+        int n = qMin(KERNEL_BATCH_SIZE, count - first);
+        KernelBatch expected;
+        KernelBatch batch;
+
+        CalculationKernel::calculateBatch(input, first, n, parameters, cache, expected);
+        CalculationKernel::calculateBatch(input, first, n, partitioned, partitionedCache, batch);
+
+        // Same results in the same order, bit by bit
+        for (int j = 0; j < n; j++) {
+
+            QCOMPARE(batch.flags[j], expected.flags[j]);
+
+            if (CalculationKernel::isCalculated(batch.flags[j])) {
+
+                abimoOutputRecord expectedRecord;
+                abimoOutputRecord record;
+
+                CalculationKernel::getRecord(input, first, j, expected, expectedRecord);
+                CalculationKernel::getRecord(input, first, j, batch, record);
+
+                QVERIFY(memcmp(&record.R, &expectedRecord.R, 8 * sizeof(float)) == 0);
+            }
+        }
+    }
+}
+
+void TestAbimo::test_kernelPolicy()
+{
+    DbaseReader reader(dataFilePath("abimo_2019_mitstrassen.dbf"), ReadMode::Streamed);
+    QVERIFY(reader.checkAndRead());
+
+    abimoColumns input;
+    int count = reader.nextChunk(input, 1024);
+    QVERIFY(count > 0);
+
+    // ETPS is 0 for all districts: no summer values
+    QHash<int, int> hash;
+    hash[0] = 0;
+
+    InitValues initValues;
+    KernelParameters withoutSummer(initValues);
+    QCOMPARE(withoutSummer.summer, true);
+
+    withoutSummer.districtETPS.compile(hash, 0);
+    withoutSummer.summer = !withoutSummer.districtETPS.isZero();
+    QCOMPARE(withoutSummer.summer, false);
+
+    // The version of the kernel with summer values gives the same results
+    KernelParameters withSummer = withoutSummer;
+    withSummer.summer = true;
+
+    ClimateCache cache;
+
+    for (int first = 0; first < count; first += KERNEL_BATCH_SIZE) {
+
+        int n = qMin(KERNEL_BATCH_SIZE, count - first);
+        KernelBatch expected;
+        KernelBatch batch;
+
+        CalculationKernel::calculateBatch(input, first, n, withSummer, cache, expected);
+        CalculationKernel::calculateBatch(input, first, n, withoutSummer, cache, batch);
+
+        for (int j = 0; j < n; j++) {
+            QCOMPARE(batch.flags[j], expected.flags[j]);
+            QVERIFY(memcmp(&batch.R[j], &expected.R[j], sizeof(float)) == 0);
+            QVERIFY(memcmp(&batch.VERDUNSTUN[j], &expected.VERDUNSTUN[j], sizeof(float)) == 0);
+        }
+    }
+}
+
 void TestAbimo::test_calc()
 {
     QString inputFile = dataFilePath("abimo_2019_mitstrassen.dbf");
@@ -162,11 +711,257 @@ void TestAbimo::test_calc()
     // Run the simulation with initial values from config file
     Calculation::calculate(inputFile, configFile, outputFile);
     QVERIFY(dbfStringsAreIdentical(outputFile, outFile_xmlConfig));
+
+    // Read, calculate and write in parallel threads
+    Calculation::calculate(inputFile, configFile, outputFile, false, true);
+    QVERIFY(dbfStringsAreIdentical(outputFile, outFile_xmlConfig));
+
+    // Stream the results (with other field widths than in the reference file)
+    Calculation::calculate(
+        inputFile, configFile, outputFile, false, true, WriteMode::Stream
+    );
+    QVERIFY(dbfValuesAreEqual(outputFile, outFile_xmlConfig));
+
+    // Write the collected results in parallel into the mapped file
+    Calculation::calculate(
+        inputFile, "", outputFile, false, false, WriteMode::Mapped
+    );
+    QVERIFY(dbfHeadersAreIdentical(outputFile, outFile_noConfig));
+    QVERIFY(dbfStringsAreIdentical(outputFile, outFile_noConfig));
+
+    // Calculate in several threads, keeping the order of the records
+    Calculation::calculate(
+        inputFile, configFile, outputFile, false, false, WriteMode::Collect, 4
+    );
+    QVERIFY(dbfStringsAreIdentical(outputFile, outFile_xmlConfig));
 }
 
 void TestAbimo::test_bagrov()
 {
+    Bagrov bagrov;
+
+    // Closed solutions of the relation: y = 1 - exp(-x) for bag = 1 and
+    // y = tanh(x) for bag = 2
+    for (float x = 0.01F; x < 15.0F; x += 0.1F) {
+        QVERIFY(fabs(bagrov.nbagroExact(1.0F, x) - (1.0 - exp(-x))) < 1.0e-6);
+        QVERIFY(fabs(bagrov.nbagroExact(2.0F, x) - tanh(x)) < 1.0e-6);
+    }
+
+    QCOMPARE(bagrov.nbagroExact(1.0F, 0.0F), 0.0F);
+
+    // bagrov() (numerical integration) gives the values of the original
+    // subroutine
+    float integrationBags[] = {0.2F, 0.5F, 1.0F, 3.0F, 10.0F};
+    float integrationXs[] = {0.0F, 0.1F, 0.5F, 0.9F, 2.0F, 5.0F};
+    float integrationYs[] = {
+        0.0F, 0.0527782664F, 0.19051142F, 0.289681852F, 0.479146123F, 0.746572137F,
+        0.0F, 0.0805696025F, 0.303950638F, 0.456452399F, 0.708223224F, 0.938673377F,
+        0.0F, 0.0951878279F, 0.393538177F, 0.593538582F, 0.864658833F, 1.0F,
+        0.0F, 0.0999750197F, 0.485144228F, 0.774252534F, 0.989486337F, 1.0F,
+        0.0F, 0.100000001F, 0.499918312F, 0.875337064F, 1.0F, 1.0F
+    };
+
+    for (int i = 0; i < 5; i++) {
+        for (int j = 0; j < 6; j++) {
+            float bag = integrationBags[i];
+            float x = integrationXs[j];
+            float y;
+            bagrov.bagrov(&bag, &x, &y);
+            QCOMPARE(y, integrationYs[i * 6 + j]);
+        }
+    }
+
+    // Dense grid over the domain (bag up to 20, x up to 15)
+    const int xCount = 301;
+    float xs[xCount];
+    float ys[xCount];
+
+    for (int j = 0; j < xCount; j++) {
+        xs[j] = j * 0.05F;
+    }
+
+    for (int i = 0; i < 399; i++) {
+
+        float bag = 0.1F + i * 0.05F;
+        float bags[xCount];
+
+        for (int j = 0; j < xCount; j++) {
+            bags[j] = bag;
+        }
 
+        bagrov.nbagro(bags, xs, ys, xCount);
+
+        for (int j = 0; j < xCount; j++) {
+
+            float x = xs[j];
+            float y = bagrov.nbagroExact(bag, x);
+            float legacy = bagrov.nbagro(bag, x);
+
+            // nbagro() of arrays gives exactly the results of nbagro()
+            QVERIFY(memcmp(&ys[j], &legacy, sizeof(float)) == 0);
+
+            // The approximations of nbagro() differ from the exact solution
+            // by up to 0.092 (bag < 0.7), 0.018 (bag up to 3.8) and 0.004
+            float tolerance = (bag < 0.7F) ? 0.1F : (bag <= 3.8F) ? 0.02F : 0.005F;
+            QVERIFY(fabs(y - legacy) < tolerance);
+
+            // Where the series of the integral of 1 / (1 - t^bag) from 0 to
+            // y converges quickly, x is that integral
+            double r = pow(y, bag);
+
+            if (r <= 0.9) {
+
+                double integral = 0.0;
+                double p = y;
+
+                for (int k = 0; k < 1000 && p > 1.0e-16 * integral; k++) {
+                    integral += p / (k * bag + 1.0);
+                    p *= r;
+                }
+
+                QVERIFY(fabs(integral - x) * (1.0 - r) < 1.0e-6);
+            }
+        }
+    }
+}
+
+void TestAbimo::test_bagrovTable()
+{
+    Bagrov bagrov;
+    BagrovTable table;
+
+    QCOMPARE(table.isEmpty(), true);
+
+    table.build();
+
+    QCOMPARE(table.isEmpty(), false);
+
+    // The estimate is no bound: allow for more at other points
+    QVERIFY(table.getErrorEstimate() < 0.02F);
+
+    float bags[] = {0.05F, 0.7F, 1.234F, 3.9F, 10.0F, 25.0F};
+    float xs[] = {0.0F, 0.0004F, 0.3F, 1.0F, 2.71F, 14.99F, 20.0F};
+
+    for (float bag : bags) {
+        for (float x : xs) {
+            QVERIFY(fabs(table.nbagro(bag, x) - bagrov.nbagro(bag, x)) < 0.025F);
+        }
+    }
+
+    // No interpolation across the jumps of the solver: on both sides of each
+    // jump the table is as close to the solver as anywhere else
+    float jumps[] = {0.49999F, 0.7F, 3.8F};
+
+    for (float jump : jumps) {
+
+        float sides[] = {nextafterf(jump, 0.0F), jump, nextafterf(jump, 20.0F)};
+
+        for (float bag : sides) {
+            for (int j = 0; j <= 600; j++) {
+                float x = j * 0.025F + 0.0125F;
+                QVERIFY(fabs(table.nbagro(bag, x) - bagrov.nbagro(bag, x)) < 0.025F);
+            }
+        }
+    }
+}
+
+void TestAbimo::benchmark_bagrovCalls_data()
+{
+    QTest::addColumn<bool>("separate");
+
+    QTest::newRow("one solver") << false;
+    QTest::newRow("sealed and unsealed solvers") << true;
+}
+
+// Replays the calls of the Bagrov solvers that the kernel makes for the test
+// data (without the record cache): for each batch, the five constant values of
+// bag of the sealed surfaces for each new pair of precipitation and
+// evaporation, then the values of bag of the unsealed surfaces. Compares one
+// solver for both with a solver for each (as in ClimateCache).
+void TestAbimo::benchmark_bagrovCalls()
+{
+    QFETCH(bool, separate);
+
+    DbaseReader reader(dataFilePath("abimo_2019_mitstrassen.dbf"), ReadMode::Streamed);
+    QVERIFY(reader.checkAndRead());
+
+    InitValues initValues;
+    KernelParameters parameters(initValues);
+    ClimateCache cache;
+
+    float sealedBags[] = {
+        parameters.bagdach, parameters.bagbel1, parameters.bagbel2,
+        parameters.bagbel3, parameters.bagbel4
+    };
+
+    // x of the sealed and (bag, x) of the unsealed surfaces, with the end of
+    // each batch in both
+    QVector<float> sealedXs;
+    QVector<float> bags;
+    QVector<float> xs;
+    QVector<int> sealedEnds;
+    QVector<int> ends;
+    QSet<QPair<float, float>> climates;
+
+    abimoColumns input;
+    int count;
+
+    while ((count = reader.nextChunk(input, 1024)) > 0) {
+        for (int first = 0; first < count; first += KERNEL_BATCH_SIZE) {
+
+            KernelBatch batch;
+            int n = qMin(KERNEL_BATCH_SIZE, count - first);
+
+            CalculationKernel::calculateBatch(input, first, n, parameters, cache, batch);
+
+            for (int j = 0; j < n; j++) {
+
+                if (!CalculationKernel::isCalculated(batch.flags[j]) ||
+                    !batch.bagrovPending[j]) {
+                    continue;
+                }
+
+                QPair<float, float> climate(batch.P[j], batch.EP[j]);
+
+                if (!climates.contains(climate)) {
+                    climates.insert(climate);
+                    sealedXs.append(batch.P[j] / batch.EP[j]);
+                }
+
+                bags.append(batch.BAG[j]);
+                xs.append(batch.X[j]);
+            }
+
+            sealedEnds.append(sealedXs.size());
+            ends.append(bags.size());
+        }
+    }
+
+    QVERIFY(bags.size() > 0);
+
+    Bagrov sealedBagrov;
+    Bagrov unsealedBagrov;
+    Bagrov& bagrov = separate ? unsealedBagrov : sealedBagrov;
+    float ys[KERNEL_BATCH_SIZE] = {0.0F};
+    float sum = 0.0F;
+
+    QBENCHMARK {
+        for (int b = 0; b < ends.size(); b++) {
+
+            for (int k = (b > 0) ? sealedEnds[b - 1] : 0; k < sealedEnds[b]; k++) {
+                for (float bag : sealedBags) {
+                    sum += sealedBagrov.nbagro(bag, sealedXs[k]);
+                }
+            }
+
+            int first = (b > 0) ? ends[b - 1] : 0;
+
+            bagrov.nbagro(bags.constData() + first, xs.constData() + first, ys, ends[b] - first);
+            sum += ys[0];
+        }
+    }
+
+    QVERIFY(sum > 0.0F);
 }
 
 bool TestAbimo::dbfHeadersAreIdentical(QString file_1, QString file_2)
@@ -244,6 +1039,48 @@ bool TestAbimo::dbfStringsAreIdentical(QString file_1, QString file_2)
     );
 }
 
+// Compare the cells as numbers if they are not identical as strings, so that
+// files that only differ in the widths of their fields are considered equal
+bool TestAbimo::dbfValuesAreEqual(QString file_1, QString file_2)
+{
+    DbaseReader reader_1(file_1);
+    DbaseReader reader_2(file_2);
+
+    reader_1.read();
+    reader_2.read();
+
+    int nrows_1 = reader_1.getNumberOfRecords();
+    int nrows_2 = reader_2.getNumberOfRecords();
+
+    if (numbersInFilesDiffer(file_1, file_2, nrows_1, nrows_2, "rows")) {
+        return false;
+    };
+
+    int ncols_1 = reader_1.getCountFields();
+    int ncols_2 = reader_2.getCountFields();
+
+    if (numbersInFilesDiffer(file_1, file_2, ncols_1, ncols_2, "columns")) {
+        return false;
+    };
+
+    for (int i = 0; i < nrows_1; i++) {
+        for (int j = 0; j < ncols_1; j++) {
+
+            QString value_1 = reader_1.getRecord(i, j);
+            QString value_2 = reader_2.getRecord(i, j);
+
+            if (value_1 != value_2 && value_1.toDouble() != value_2.toDouble()) {
+                qDebug() << QString("Values differ in row %1, column %2: %3 vs %4").arg(
+                    QString::number(i), QString::number(j), value_1, value_2
+                );
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 bool TestAbimo::numbersInFilesDiffer(QString file_1, QString file_2, int n_1, int n_2, QString subject)
 {
     if (n_1 != n_2) {